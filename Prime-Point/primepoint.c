@@ -16,6 +16,11 @@
 #include <openssl/err.h>
 #define MAX_BUFFER_SIZE 1024
 
+/* Optimization barrier: the compiler has to assume value is read and
+   changed here, so the work that produced it cannot be dropped or
+   folded away */
+#define DO_NOT_OPTIMIZE(value) __asm__ volatile("" : "+g"(value) : : "memory")
+
 struct benchmark
 {
     /* data */
@@ -69,6 +74,13 @@ void BenchmarkToJson(struct benchmark benchmark, char *jsonString)
             benchmark.time, benchmark.hostname, benchmark.key, benchmark.processes);
 }
 
+/* Print a verification line and return whether it passed */
+bool verify(const char *what, bool passed)
+{
+    printf("Verification of %s: %s\n", what, passed ? "passed" : "FAILED");
+    return passed;
+}
+
 /* Thread function for counting primes */
 void *
 prime_check(void *_args)
@@ -103,7 +115,7 @@ prime_check(void *_args)
     pthread_exit(NULL);
 }
 
-int multicore_processing_prime(int64_t digits, int num_threads)
+int64_t multicore_processing_prime(int64_t digits, int num_threads)
 {
     pthread_t threads[num_threads];
     struct range *args[num_threads];
@@ -117,17 +129,20 @@ int multicore_processing_prime(int64_t digits, int num_threads)
     int64_t start = 0;
     int64_t end = start + number_count;
     int64_t number_per_thread = number_count / num_threads;
+    int64_t remaining_numbers = number_count % num_threads;
 
-    /* Simplification: make range divide evenly among the threads */
-    // assert(number_count % num_threads == 0);
-
-    /* Assign a start/end value for each thread, then create it */
+    /* Assign a start/end value for each thread, then create it. The
+       first number_count % num_threads threads take one extra number. */
+    int64_t next_start = start;
     for (thread = 0; thread < num_threads; thread++)
     {
         args[thread] = calloc(sizeof(struct range), 1);
-        args[thread]->start = start + (thread * number_per_thread);
+        args[thread]->start = next_start;
         args[thread]->end =
             args[thread]->start + number_per_thread - 1;
+        if (thread < remaining_numbers)
+            args[thread]->end++;
+        next_start = args[thread]->end + 1;
         assert(pthread_create(&threads[thread], NULL, prime_check,
                               args[thread]) == 0);
     }
@@ -148,21 +163,34 @@ int multicore_processing_prime(int64_t digits, int num_threads)
     // printf("Total number of primes less than %ld: %ld\n", end,
     //        total_number);
 
-    return 0;
+    return total_number;
 }
 
-double calculate_execution_time_prime(int digits, int num_threads)
+double calculate_execution_time_prime(int digits, int num_threads, int64_t *total)
 {
 
     struct timeval start, end;
     gettimeofday(&start, NULL);
-    multicore_processing_prime(digits, num_threads);
+    int64_t result = multicore_processing_prime(digits, num_threads);
+    DO_NOT_OPTIMIZE(result);
     gettimeofday(&end, NULL);
+    *total = result;
     double time_taken = end.tv_sec + end.tv_usec / 1e6 -
                         start.tv_sec - start.tv_usec / 1e6; // in seconds
     return time_taken;
 }
 
+/* pi(5 * 10^7), the prime count the benchmark's default limit must give */
+#define PRIMES_BELOW_50M 3001134
+
+bool verify_prime_count(const char *what, int64_t digits, int64_t count)
+{
+    printf("%s prime count below %" PRId64 ": %" PRId64 "\n", what, digits, count);
+    if (digits != 50000000L)
+        return true;
+    return verify(what, count == PRIMES_BELOW_50M);
+}
+
 int calculate_score_prime(int digits, double execution_time)
 {
     int multi_core_score = (digits / execution_time) / 666;
@@ -181,6 +209,8 @@ int64_t add_to_number(int64_t n)
     for (i = 0; i < n; i++)
     {
         sum = increment(sum);
+        /* Without this the loop folds into return n */
+        DO_NOT_OPTIMIZE(sum);
     }
     return sum;
 }
@@ -211,18 +241,27 @@ int64_t add_to_number_parallel(int64_t n, int num_threads)
     return sum;
 }
 
-double calculate_execution_time_point(int64_t digits, int num_threads)
+double calculate_execution_time_point(int64_t digits, int num_threads, int64_t *sum)
 {
 
     struct timeval start, end;
     gettimeofday(&start, NULL);
-    add_to_number_parallel(digits, num_threads);
+    int64_t result = add_to_number_parallel(digits, num_threads);
+    DO_NOT_OPTIMIZE(result);
     gettimeofday(&end, NULL);
+    *sum = result;
     double time_taken = end.tv_sec + end.tv_usec / 1e6 -
                         start.tv_sec - start.tv_usec / 1e6; // in seconds
     return time_taken;
 }
 
+/* Every thread adds one n / num_threads times */
+bool verify_point_sum(const char *what, int64_t digits, int num_threads, int64_t sum)
+{
+    printf("%s sum: %" PRId64 "\n", what, sum);
+    return verify(what, sum == digits / num_threads * num_threads);
+}
+
 int64_t calculate_score_point(int64_t digits, double execution_time)
 {
     int64_t multi_core_score = (digits / execution_time) / 666666 * 1.213;
@@ -404,10 +443,15 @@ int main(int argc, char **argv)
 
 #endif
 
-    double execution_time_single_core_point = calculate_execution_time_point(digits_point, 1);
-    double execution_time_single_core_prime = calculate_execution_time_prime(digits_prime, 1);
-    double execution_time_multi_core_point = calculate_execution_time_point(digits_point, processes);
-    double execution_time_multi_core_prime = calculate_execution_time_prime(digits_prime, processes);
+    int64_t sum_single_core, sum_multi_core, primes_single_core, primes_multi_core;
+    double execution_time_single_core_point = calculate_execution_time_point(digits_point, 1, &sum_single_core);
+    double execution_time_single_core_prime = calculate_execution_time_prime(digits_prime, 1, &primes_single_core);
+    double execution_time_multi_core_point = calculate_execution_time_point(digits_point, processes, &sum_multi_core);
+    double execution_time_multi_core_prime = calculate_execution_time_prime(digits_prime, processes, &primes_multi_core);
+    bool valid = verify_point_sum("single core", digits_point, 1, sum_single_core);
+    valid = verify_point_sum("multi core", digits_point, processes, sum_multi_core) && valid;
+    valid = verify_prime_count("single core", digits_prime, primes_single_core) && valid;
+    valid = verify_prime_count("multi core", digits_prime, primes_multi_core) && valid;
     int64_t score_single_core_point = calculate_score_point(digits_point, execution_time_single_core_point);
     int64_t score_multi_core_point = calculate_score_point(digits_point, execution_time_multi_core_point);
     int64_t score_single_core_prime = calculate_score_prime(digits_prime, execution_time_single_core_prime);
@@ -476,6 +520,12 @@ int main(int argc, char **argv)
     char jsonString[1024];
     BenchmarkToJson(benchmark, jsonString);
 
+    if (!valid)
+    {
+        printf("Result verification failed, run marked invalid and not uploaded\n");
+        return EXIT_FAILURE;
+    }
+
     // Server information
     const char *host = "taipan-benchmarks.vercel.app";
     const char *path = "/api/cpu-benchmarks";
@@ -14,8 +14,19 @@
 #include <arpa/inet.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <limits.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #define MAX_BUFFER_SIZE 1024
 
+/* Optimization barrier: the compiler has to assume value is read and
+   changed here, so the work that produced it cannot be dropped or
+   folded away */
+#define DO_NOT_OPTIMIZE(value) __asm__ volatile("" : "+g"(value) : : "memory")
+
 /* Each thread gets a start and end number and returns the number
    Of primes in that range */
 struct range
@@ -71,92 +82,521 @@ void primeBenchmarkToJson(struct prime_benchmark benchmark, char *jsonString)
             benchmark.time, benchmark.hostname, benchmark.key, benchmark.processes);
 }
 
+/* Print a verification line and return whether it passed */
+bool verify(const char *what, bool passed)
+{
+    printf("Verification of %s: %s\n", what, passed ? "passed" : "FAILED");
+    return passed;
+}
+
 // Structure to pass arguments to the thread function
 struct range_array
 {
-    int64_t *array;
+    int *array;
+    int *scratch;
     int64_t start;
     int64_t end;
+    bool start_in_scratch;
 };
 
-// Function to merge two sorted arrays
-void merge(int *array, int start, int mid, int end)
+/* Runs this short are insertion sorted before any merging */
+#define INSERTION_SORT_CUTOFF 32
+
+// Function to insertion sort array[start, end)
+void insertion_sort(int *array, int start, int end)
 {
-    int n1 = mid - start + 1;
-    int n2 = end - mid;
+    for (int i = start + 1; i < end; i++)
+    {
+        int value = array[i];
+        int j = i - 1;
+        while (j >= start && array[j] > value)
+        {
+            array[j + 1] = array[j];
+            j--;
+        }
+        array[j + 1] = value;
+    }
+}
 
-    int *left = malloc(n1 * sizeof(int));
-    int *right = malloc(n2 * sizeof(int));
+/* Function to merge the sorted arrays left[0, n1) and right[0, n2) into
+   dst; ties take left first. On random keys which side an element comes
+   from is a coin flip, so the choice is made with a conditional move and
+   index arithmetic instead of a branch that mispredicts half the time */
+void merge_scalar(const int *left, int n1, const int *right, int n2, int *dst)
+{
+    int i = 0, j = 0, k = 0;
+    while (i < n1 && j < n2)
+    {
+        int a = left[i], b = right[j];
+        bool take_left = a <= b;
+        dst[k++] = take_left ? a : b;
+        i += take_left;
+        j += !take_left;
+    }
 
-    for (int i = 0; i < n1; i++)
-        left[i] = array[start + i];
-    for (int j = 0; j < n2; j++)
-        right[j] = array[mid + 1 + j];
+    memcpy(dst + k, left + i, (n1 - i) * sizeof(int));
+    k += n1 - i;
+    memcpy(dst + k, right + j, (n2 - j) * sizeof(int));
+}
 
-    int i = 0, j = 0, k = start;
-    while (i < n1 && j < n2)
+/* SIMD sort kernels: blocks of BITONIC_BLOCK elements are sorted by
+   bitonic networks held in registers, and merges run a vector at a time.
+   Both are built from one compare-exchange step, in which every lane
+   meets the lane whose index differs by partner_xor and the lanes with
+   max_bit set in their index keep the larger value:
+   - sorting one vector takes the steps of a bitonic sort, where a
+     sequence of size s is first compared against its own mirror image
+     (partner s - 1) and then cleaned with partners s / 4, ..., 1;
+   - two sorted runs of registers merge by reversing the second run,
+     which makes the whole sequence bitonic, and cleaning it: min/max
+     between registers down to neighbouring ones, then inside each
+     register with partners lanes / 2, ..., 1 */
+#define BITONIC_BLOCK 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("avx2"))) static inline __m256i bitonic_step_avx2(__m256i v, int partner_xor, int max_bit)
+{
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i partner = _mm256_permutevar8x32_epi32(v, _mm256_xor_si256(lanes, _mm256_set1_epi32(partner_xor)));
+    __m256i take_max = _mm256_cmpeq_epi32(_mm256_and_si256(lanes, _mm256_set1_epi32(max_bit)), _mm256_set1_epi32(max_bit));
+    return _mm256_blendv_epi8(_mm256_min_epi32(v, partner), _mm256_max_epi32(v, partner), take_max);
+}
+
+__attribute__((target("avx2"))) static inline __m256i bitonic_reverse_avx2(__m256i v)
+{
+    return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+__attribute__((target("avx2"))) static inline __m256i bitonic_clean_vector_avx2(__m256i v)
+{
+    v = bitonic_step_avx2(v, 4, 4);
+    v = bitonic_step_avx2(v, 2, 2);
+    return bitonic_step_avx2(v, 1, 1);
+}
+
+__attribute__((target("avx2"))) static inline __m256i bitonic_sort_vector_avx2(__m256i v)
+{
+    v = bitonic_step_avx2(v, 1, 1);
+    v = bitonic_step_avx2(v, 3, 2);
+    v = bitonic_step_avx2(v, 1, 1);
+    v = bitonic_step_avx2(v, 7, 4);
+    v = bitonic_step_avx2(v, 2, 2);
+    return bitonic_step_avx2(v, 1, 1);
+}
+
+// Sort the bitonic sequence in registers v[0, n)
+__attribute__((target("avx2"))) static inline void bitonic_clean_avx2(__m256i *v, int n)
+{
+    #pragma GCC unroll 8
+    for (int s = n / 2; s > 0; s /= 2)
+        #pragma GCC unroll 8
+        for (int r = 0; r + s < n; r++)
+            if (!(r & s))
+            {
+                __m256i low = _mm256_min_epi32(v[r], v[r + s]);
+                v[r + s] = _mm256_max_epi32(v[r], v[r + s]);
+                v[r] = low;
+            }
+    #pragma GCC unroll 8
+    for (int r = 0; r < n; r++)
+        v[r] = bitonic_clean_vector_avx2(v[r]);
+}
+
+// Merge the sorted runs in registers v[0, n / 2) and v[n / 2, n)
+__attribute__((target("avx2"))) static inline void bitonic_merge_avx2(__m256i *v, int n)
+{
+    #pragma GCC unroll 8
+    for (int r = 0; r < n / 4; r++)
     {
-        if (left[i] <= right[j])
-        {
-            array[k] = left[i];
-            i++;
-        }
-        else
-        {
-            array[k] = right[j];
-            j++;
-        }
-        k++;
+        __m256i t = v[n / 2 + r];
+        v[n / 2 + r] = v[n - 1 - r];
+        v[n - 1 - r] = t;
+    }
+    #pragma GCC unroll 8
+    for (int r = n / 2; r < n; r++)
+        v[r] = bitonic_reverse_avx2(v[r]);
+    bitonic_clean_avx2(v, n);
+}
+
+// Sort array[start, end), at most BITONIC_BLOCK elements, as 8 vectors of 8
+__attribute__((target("avx2"))) void bitonic_sort_avx2(int *array, int start, int end)
+{
+    int n = end - start;
+    int block[BITONIC_BLOCK];
+    int *p = array + start;
+    if (n < BITONIC_BLOCK)
+    {
+        // A short block is padded with values that sort to its end
+        memcpy(block, p, n * sizeof(int));
+        for (int i = n; i < BITONIC_BLOCK; i++)
+            block[i] = INT_MAX;
+        p = block;
+    }
+    __m256i v[8];
+    #pragma GCC unroll 8
+    for (int r = 0; r < 8; r++)
+        v[r] = bitonic_sort_vector_avx2(_mm256_loadu_si256((const __m256i *)(p + 8 * r)));
+    #pragma GCC unroll 8
+    for (int runs = 2; runs <= 8; runs *= 2)
+        #pragma GCC unroll 8
+        for (int r = 0; r < 8; r += runs)
+            bitonic_merge_avx2(v + r, runs);
+    #pragma GCC unroll 8
+    for (int r = 0; r < 8; r++)
+        _mm256_storeu_si256((__m256i *)(p + 8 * r), v[r]);
+    if (p == block)
+        memcpy(array + start, block, n * sizeof(int));
+}
+
+/* Vector merge: a register pair holds the next 16 candidates, and each
+   round writes out the lower 8 and loads 8 more from the input whose
+   next element is smaller. What is left when one input runs short, the
+   upper register and the short rest, is merged by merge_scalar */
+__attribute__((target("avx2"))) void merge_avx2(const int *left, int n1, const int *right, int n2, int *dst)
+{
+    if (n1 < 8 || n2 < 8)
+    {
+        merge_scalar(left, n1, right, n2, dst);
+        return;
+    }
+    __m256i v[2];
+    v[0] = _mm256_loadu_si256((const __m256i *)left);
+    v[1] = _mm256_loadu_si256((const __m256i *)right);
+    int i = 8, j = 8, k = 0;
+    for (;;)
+    {
+        bitonic_merge_avx2(v, 2);
+        _mm256_storeu_si256((__m256i *)(dst + k), v[0]);
+        k += 8;
+        if (i + 8 > n1 || j + 8 > n2)
+            break;
+        bool take_left = left[i] <= right[j];
+        v[0] = _mm256_loadu_si256((const __m256i *)(take_left ? left + i : right + j));
+        i += take_left ? 8 : 0;
+        j += take_left ? 0 : 8;
+    }
+    int upper[8], rest[16];
+    _mm256_storeu_si256((__m256i *)upper, v[1]);
+    if (i + 8 > n1)
+    {
+        merge_scalar(upper, 8, left + i, n1 - i, rest);
+        merge_scalar(rest, 8 + n1 - i, right + j, n2 - j, dst + k);
+    }
+    else
+    {
+        merge_scalar(upper, 8, right + j, n2 - j, rest);
+        merge_scalar(rest, 8 + n2 - j, left + i, n1 - i, dst + k);
     }
+}
+
+/* The same kernels with 16 lanes: a block is 4 vectors of 16 */
+__attribute__((target("avx512f"))) static inline __m512i bitonic_step_avx512(__m512i v, int partner_xor, int max_bit)
+{
+    __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i partner = _mm512_permutexvar_epi32(_mm512_xor_si512(lanes, _mm512_set1_epi32(partner_xor)), v);
+    // The lanes without max_bit set are 0x5555, 0x3333, 0x0f0f or 0x00ff
+    __mmask16 take_max = 0xffff ^ 0xffff / ((1 << max_bit) + 1);
+    return _mm512_mask_blend_epi32(take_max, _mm512_min_epi32(v, partner), _mm512_max_epi32(v, partner));
+}
+
+__attribute__((target("avx512f"))) static inline __m512i bitonic_reverse_avx512(__m512i v)
+{
+    return _mm512_permutexvar_epi32(_mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0), v);
+}
+
+__attribute__((target("avx512f"))) static inline __m512i bitonic_clean_vector_avx512(__m512i v)
+{
+    v = bitonic_step_avx512(v, 8, 8);
+    v = bitonic_step_avx512(v, 4, 4);
+    v = bitonic_step_avx512(v, 2, 2);
+    return bitonic_step_avx512(v, 1, 1);
+}
+
+__attribute__((target("avx512f"))) static inline __m512i bitonic_sort_vector_avx512(__m512i v)
+{
+    v = bitonic_step_avx512(v, 1, 1);
+    v = bitonic_step_avx512(v, 3, 2);
+    v = bitonic_step_avx512(v, 1, 1);
+    v = bitonic_step_avx512(v, 7, 4);
+    v = bitonic_step_avx512(v, 2, 2);
+    v = bitonic_step_avx512(v, 1, 1);
+    v = bitonic_step_avx512(v, 15, 8);
+    v = bitonic_step_avx512(v, 4, 4);
+    v = bitonic_step_avx512(v, 2, 2);
+    return bitonic_step_avx512(v, 1, 1);
+}
+
+__attribute__((target("avx512f"))) static inline void bitonic_clean_avx512(__m512i *v, int n)
+{
+    #pragma GCC unroll 8
+    for (int s = n / 2; s > 0; s /= 2)
+        #pragma GCC unroll 8
+        for (int r = 0; r + s < n; r++)
+            if (!(r & s))
+            {
+                __m512i low = _mm512_min_epi32(v[r], v[r + s]);
+                v[r + s] = _mm512_max_epi32(v[r], v[r + s]);
+                v[r] = low;
+            }
+    #pragma GCC unroll 8
+    for (int r = 0; r < n; r++)
+        v[r] = bitonic_clean_vector_avx512(v[r]);
+}
 
-    while (i < n1)
+__attribute__((target("avx512f"))) static inline void bitonic_merge_avx512(__m512i *v, int n)
+{
+    #pragma GCC unroll 8
+    for (int r = 0; r < n / 4; r++)
     {
-        array[k] = left[i];
-        i++;
-        k++;
+        __m512i t = v[n / 2 + r];
+        v[n / 2 + r] = v[n - 1 - r];
+        v[n - 1 - r] = t;
     }
+    #pragma GCC unroll 8
+    for (int r = n / 2; r < n; r++)
+        v[r] = bitonic_reverse_avx512(v[r]);
+    bitonic_clean_avx512(v, n);
+}
 
-    while (j < n2)
+__attribute__((target("avx512f"))) void bitonic_sort_avx512(int *array, int start, int end)
+{
+    int n = end - start;
+    int block[BITONIC_BLOCK];
+    int *p = array + start;
+    if (n < BITONIC_BLOCK)
     {
-        array[k] = right[j];
-        j++;
-        k++;
+        memcpy(block, p, n * sizeof(int));
+        for (int i = n; i < BITONIC_BLOCK; i++)
+            block[i] = INT_MAX;
+        p = block;
     }
+    __m512i v[4];
+    #pragma GCC unroll 8
+    for (int r = 0; r < 4; r++)
+        v[r] = bitonic_sort_vector_avx512(_mm512_loadu_si512(p + 16 * r));
+    #pragma GCC unroll 8
+    for (int runs = 2; runs <= 4; runs *= 2)
+        #pragma GCC unroll 8
+        for (int r = 0; r < 4; r += runs)
+            bitonic_merge_avx512(v + r, runs);
+    #pragma GCC unroll 8
+    for (int r = 0; r < 4; r++)
+        _mm512_storeu_si512(p + 16 * r, v[r]);
+    if (p == block)
+        memcpy(array + start, block, n * sizeof(int));
+}
 
-    free(left);
-    free(right);
+__attribute__((target("avx512f"))) void merge_avx512(const int *left, int n1, const int *right, int n2, int *dst)
+{
+    if (n1 < 16 || n2 < 16)
+    {
+        merge_scalar(left, n1, right, n2, dst);
+        return;
+    }
+    __m512i v[2];
+    v[0] = _mm512_loadu_si512(left);
+    v[1] = _mm512_loadu_si512(right);
+    int i = 16, j = 16, k = 0;
+    for (;;)
+    {
+        bitonic_merge_avx512(v, 2);
+        _mm512_storeu_si512(dst + k, v[0]);
+        k += 16;
+        if (i + 16 > n1 || j + 16 > n2)
+            break;
+        bool take_left = left[i] <= right[j];
+        v[0] = _mm512_loadu_si512(take_left ? left + i : right + j);
+        i += take_left ? 16 : 0;
+        j += take_left ? 0 : 16;
+    }
+    int upper[16], rest[32];
+    _mm512_storeu_si512(upper, v[1]);
+    if (i + 16 > n1)
+    {
+        merge_scalar(upper, 16, left + i, n1 - i, rest);
+        merge_scalar(rest, 16 + n1 - i, right + j, n2 - j, dst + k);
+    }
+    else
+    {
+        merge_scalar(upper, 16, right + j, n2 - j, rest);
+        merge_scalar(rest, 16 + n2 - j, left + i, n1 - i, dst + k);
+    }
 }
+#endif
 
-// Function to perform merge sort on a range of the array
-void merge_sort(int *array, int start, int end)
+/* Instruction set of the sort kernels, picked by CPUID in
+   sort_kernel_init unless capped with -i. Runs of sort_run_length are
+   sorted by sort_run_kernel before any merging, and every merge goes
+   through merge_kernel */
+const char *sort_isa = NULL;
+int sort_run_length = INSERTION_SORT_CUTOFF;
+void (*sort_run_kernel)(int *array, int start, int end) = insertion_sort;
+void (*merge_kernel)(const int *left, int n1, const int *right, int n2, int *dst) = merge_scalar;
+
+/* Pick the widest kernels the CPU supports, at most the ones asked for
+   with -i; scalar is insertion sort and merge_scalar */
+void sort_kernel_init(void)
 {
-    if (start < end)
+    const char *requested = sort_isa;
+    sort_isa = "scalar";
+    sort_run_length = INSERTION_SORT_CUTOFF;
+    sort_run_kernel = insertion_sort;
+    merge_kernel = merge_scalar;
+    if (requested != NULL && strcmp(requested, "scalar") == 0)
+        return;
+#if defined(__x86_64__) || defined(__i386__)
+    bool allow_avx512 = requested == NULL || strcmp(requested, "avx512") == 0;
+    bool allow_avx2 = allow_avx512 || strcmp(requested, "avx2") == 0;
+    if (allow_avx512 && __builtin_cpu_supports("avx512f"))
     {
-        int mid = start + (end - start) / 2;
+        sort_isa = "avx512";
+        sort_run_length = BITONIC_BLOCK;
+        sort_run_kernel = bitonic_sort_avx512;
+        merge_kernel = merge_avx512;
+    }
+    else if (allow_avx2 && __builtin_cpu_supports("avx2"))
+    {
+        sort_isa = "avx2";
+        sort_run_length = BITONIC_BLOCK;
+        sort_run_kernel = bitonic_sort_avx2;
+        merge_kernel = merge_avx2;
+    }
+#endif
+}
 
-        merge_sort(array, start, mid);
-        merge_sort(array, mid + 1, end);
+// Function to merge the sorted arrays left[0, n1) and right[0, n2) into dst with the selected kernel
+void merge(const int *left, int n1, const int *right, int n2, int *dst)
+{
+    merge_kernel(left, n1, right, n2, dst);
+}
+
+// Function to merge the sorted runs src[start, mid) and src[mid, end) into dst[start, end)
+void merge_runs(const int *src, int *dst, int start, int mid, int end)
+{
+    merge(src + start, mid - start, src + mid, end - mid, dst + start);
+}
 
-        merge(array, start, mid, end);
+/* Bottom-up merge sort of array[start, end], with scratch[start, end] as
+   the only extra memory: runs of sort_run_length are sorted in place by
+   sort_run_kernel, then each pass merges pairs of runs from one buffer
+   into the other and the two buffers swap roles */
+void merge_sort(int *array, int *scratch, int start, int end)
+{
+    int size = end - start + 1;
+    if (size < 2)
+        return;
+    for (int i = start; i <= end; i += sort_run_length)
+        sort_run_kernel(array, i, i + sort_run_length <= end ? i + sort_run_length : end + 1);
+
+    int *src = array, *dst = scratch;
+    for (int64_t width = sort_run_length; width < size; width *= 2)
+    {
+        for (int64_t i = start; i <= end; i += 2 * width)
+        {
+            int mid = i + width <= end ? i + width : end + 1;
+            int stop = i + 2 * width <= end ? i + 2 * width : end + 1;
+            merge_runs(src, dst, i, mid, stop);
+        }
+        int *t = src;
+        src = dst;
+        dst = t;
     }
+
+    // An odd number of passes leaves the result in scratch
+    if (src != array)
+        memcpy(array + start, src + start, size * sizeof(int));
 }
 
 // Thread function for sorting a portion of the array
 void *sort_array_thread(void *_args)
 {
     struct range_array *args = (struct range_array *)_args;
-    merge_sort(args->array, args->start, args->end);
+    merge_sort(args->array, args->scratch, args->start, args->end);
+
+    /* The merge levels alternate between the buffers and have to end in
+       array, so with an odd number of them they start from scratch */
+    if (args->start_in_scratch)
+        memcpy(args->scratch + args->start, args->array + args->start,
+               (args->end - args->start + 1) * sizeof(int));
+
+    pthread_exit(NULL);
+}
+
+/* One level of the final merge: sorted segment p is src[bounds[p],
+   bounds[p + 1]), and segments 2q and 2q + 1 merge into dst at the same
+   place (a last odd segment is copied). Each thread writes an equal slice
+   [start, end) of dst, so all threads take part in every merge */
+struct merge_level
+{
+    const int *src;
+    int *dst;
+    const int *bounds;
+    int segments;
+};
+
+struct merge_slice
+{
+    const struct merge_level *level;
+    int start;
+    int end;
+};
+
+/* Merge path: how many of the first k outputs of merging a and b come
+   from a. Too few while a[i] would still be taken before b[k - i - 1] */
+int co_rank(int k, const int *a, int na, const int *b, int nb)
+{
+    int low = k > nb ? k - nb : 0;
+    int high = k < na ? k : na;
+    while (low < high)
+    {
+        int i = low + (high - low) / 2;
+        if (a[i] <= b[k - i - 1])
+            low = i + 1;
+        else
+            high = i;
+    }
+    return low;
+}
+
+// Thread function for one slice of a merge level
+void *merge_level_thread(void *_args)
+{
+    struct merge_slice *args = (struct merge_slice *)_args;
+    const struct merge_level *level = args->level;
+    for (int p = 0; p < level->segments; p += 2)
+    {
+        int start = level->bounds[p];
+        int mid = level->bounds[p + 1];
+        int end = p + 2 <= level->segments ? level->bounds[p + 2] : mid;
+        int low = args->start > start ? args->start : start;
+        int high = args->end < end ? args->end : end;
+        if (low >= high)
+            continue;
+
+        const int *a = level->src + start, *b = level->src + mid;
+        int i0 = co_rank(low - start, a, mid - start, b, end - mid);
+        int i1 = co_rank(high - start, a, mid - start, b, end - mid);
+        int j0 = low - start - i0, j1 = high - start - i1;
+        merge(a + i0, i1 - i0, b + j0, j1 - j0, level->dst + low);
+    }
 
     pthread_exit(NULL);
 }
 
 // Function to sort an array using multiple threads
-void multicore_processing_sort(int *array, int array_size, int num_threads)
+void multicore_processing_sort(int *array, int *scratch, int array_size, int num_threads)
 {
     pthread_t threads[num_threads];
     struct range_array args[num_threads];
+    int bounds[num_threads + 1];
     int thread;
 
+    int levels = 0;
+    while ((1 << levels) < num_threads)
+        levels++;
+
     int elements_per_thread = array_size / num_threads;
     int remaining_elements = array_size % num_threads;
 
@@ -164,8 +604,10 @@ void multicore_processing_sort(int *array, int array_size, int num_threads)
     for (thread = 0; thread < num_threads; thread++)
     {
         args[thread].array = array;
+        args[thread].scratch = scratch;
         args[thread].start = start;
         args[thread].end = start + elements_per_thread - 1;
+        args[thread].start_in_scratch = levels % 2 == 1;
 
         if (remaining_elements > 0)
         {
@@ -173,10 +615,12 @@ void multicore_processing_sort(int *array, int array_size, int num_threads)
             remaining_elements--;
         }
 
+        bounds[thread] = start;
         start = args[thread].end + 1;
 
         assert(pthread_create(&threads[thread], NULL, sort_array_thread, &args[thread]) == 0);
     }
+    bounds[num_threads] = array_size;
 
     // Join all threads to wait for sorting completion
     for (thread = 0; thread < num_threads; thread++)
@@ -184,41 +628,286 @@ void multicore_processing_sort(int *array, int array_size, int num_threads)
         pthread_join(threads[thread], NULL);
     }
 
-    // Merge the sorted segments
-    int merged_size = elements_per_thread * num_threads;
-    while (merged_size < array_size)
+    // Merge the sorted segments pairwise, level by level, with every thread on every level
+    struct merge_level level = {levels % 2 == 1 ? scratch : array, levels % 2 == 1 ? array : scratch,
+                                bounds, num_threads};
+    struct merge_slice slices[num_threads];
+    while (level.segments > 1)
     {
-        for (int i = 0; i < array_size; i += merged_size * 2)
+        for (thread = 0; thread < num_threads; thread++)
+        {
+            slices[thread].level = &level;
+            slices[thread].start = (int64_t)array_size * thread / num_threads;
+            slices[thread].end = (int64_t)array_size * (thread + 1) / num_threads;
+            assert(pthread_create(&threads[thread], NULL, merge_level_thread, &slices[thread]) == 0);
+        }
+        for (thread = 0; thread < num_threads; thread++)
         {
-            int start = i;
-            int mid = i + merged_size - 1;
-            int end = i + merged_size * 2 - 1;
+            pthread_join(threads[thread], NULL);
+        }
 
-            if (mid >= array_size)
-                continue;
+        // Segment q of the next level is segments 2q and 2q + 1 of this one
+        for (int q = 0; 2 * q < level.segments; q++)
+            bounds[q] = bounds[2 * q];
+        bounds[(level.segments + 1) / 2] = array_size;
+        level.segments = (level.segments + 1) / 2;
+        int *t = (int *)level.src;
+        level.src = level.dst;
+        level.dst = t;
+    }
+}
 
-            if (end >= array_size)
-                end = array_size - 1;
+/* How the multicore sort shares out work: static gives every thread one
+   contiguous slice up front, steal runs fork-join tasks on per-thread
+   work-stealing deques */
+enum sort_mode
+{
+    SORT_STEAL,
+    SORT_STATIC,
+};
 
-            merge(array, start, mid, end);
-        }
+const char *sort_mode_names[] = {"steal", "static"};
+
+enum sort_mode sort_mode = SORT_STEAL;
+
+/* Ranges of at most this many elements are sorted, and merges of at most
+   this many elements are merged, without forking further */
+#define STEAL_SORT_CUTOFF 65536
+#define STEAL_MERGE_CUTOFF 65536
+
+/* Tasks a deque can hold; a task that does not fit runs on the spot */
+#define STEAL_DEQUE_SIZE 1024
+
+/* One forked half of a sort or a merge. It lives in the stack frame of
+   the task that forked it, which waits for done before returning */
+struct steal_task
+{
+    bool is_merge;
+    /* Sort: src[lo, hi) ends up sorted in dst[lo, hi), other[lo, hi) is
+       free scratch, and dst is one of src and other */
+    int *src, *other, *dst;
+    int lo, hi;
+    /* Merge: left[0, n1) and right[0, n2) into out */
+    const int *left, *right;
+    int n1, n2;
+    int *out;
+    atomic_bool done;
+};
+
+/* The owner pushes and pops at the bottom, thieves take the oldest and
+   biggest task from the top */
+struct steal_worker
+{
+    pthread_mutex_t lock;
+    struct steal_task *tasks[STEAL_DEQUE_SIZE];
+    int64_t top, bottom;
+    int id;
+    struct steal_pool *pool;
+    pthread_t thread;
+} __attribute__((aligned(64)));
+
+struct steal_pool
+{
+    struct steal_worker *workers;
+    int num_workers;
+    atomic_bool finished;
+};
+
+bool steal_push(struct steal_worker *worker, struct steal_task *task)
+{
+    pthread_mutex_lock(&worker->lock);
+    bool pushed = worker->bottom - worker->top < STEAL_DEQUE_SIZE;
+    if (pushed)
+        worker->tasks[worker->bottom++ % STEAL_DEQUE_SIZE] = task;
+    pthread_mutex_unlock(&worker->lock);
+    return pushed;
+}
+
+struct steal_task *steal_pop(struct steal_worker *worker)
+{
+    struct steal_task *task = NULL;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->bottom > worker->top)
+        task = worker->tasks[--worker->bottom % STEAL_DEQUE_SIZE];
+    pthread_mutex_unlock(&worker->lock);
+    return task;
+}
 
-        merged_size *= 2;
+struct steal_task *steal_take(struct steal_worker *victim)
+{
+    struct steal_task *task = NULL;
+    pthread_mutex_lock(&victim->lock);
+    if (victim->bottom > victim->top)
+        task = victim->tasks[victim->top++ % STEAL_DEQUE_SIZE];
+    pthread_mutex_unlock(&victim->lock);
+    return task;
+}
+
+/* The worker's own newest task, or else the oldest one of another worker */
+struct steal_task *steal_find(struct steal_worker *worker)
+{
+    struct steal_task *task = steal_pop(worker);
+    for (int i = 1; task == NULL && i < worker->pool->num_workers; i++)
+        task = steal_take(&worker->pool->workers[(worker->id + i) % worker->pool->num_workers]);
+    return task;
+}
+
+void steal_run(struct steal_worker *worker, struct steal_task *task);
+
+/* Queue task for any worker, or run it here if the deque is full */
+void steal_fork(struct steal_worker *worker, struct steal_task *task)
+{
+    atomic_store(&task->done, false);
+    if (!steal_push(worker, task))
+        steal_run(worker, task);
+}
+
+/* Wait for a forked task, running other tasks instead of idling */
+void steal_join(struct steal_worker *worker, struct steal_task *task)
+{
+    while (!atomic_load_explicit(&task->done, memory_order_acquire))
+    {
+        struct steal_task *other = steal_find(worker);
+        if (other != NULL)
+            steal_run(worker, other);
+        else
+            sched_yield();
+    }
+}
+
+/* Split the merge at the middle of its output with merge path, fork the
+   second half and merge the first here */
+void steal_merge(struct steal_worker *worker, const int *left, int n1, const int *right, int n2, int *out)
+{
+    if (n1 + n2 <= STEAL_MERGE_CUTOFF)
+    {
+        merge(left, n1, right, n2, out);
+        return;
+    }
+    int k = (n1 + n2) / 2;
+    int i = co_rank(k, left, n1, right, n2);
+    struct steal_task second = {.is_merge = true, .left = left + i, .right = right + k - i,
+                                .n1 = n1 - i, .n2 = n2 - (k - i), .out = out + k};
+    steal_fork(worker, &second);
+    steal_merge(worker, left, i, right, k - i, out);
+    steal_join(worker, &second);
+}
+
+/* Sort src[lo, hi) into dst: both halves are sorted into the buffer that
+   is not dst, the second one as a forked task, and merged back into dst */
+void steal_sort(struct steal_worker *worker, int *src, int *other, int *dst, int lo, int hi)
+{
+    if (hi - lo <= STEAL_SORT_CUTOFF)
+    {
+        merge_sort(src, other, lo, hi - 1);
+        if (dst != src)
+            memcpy(dst + lo, src + lo, (hi - lo) * sizeof(int));
+        return;
     }
+    int *halves = dst == src ? other : src;
+    int mid = lo + (hi - lo) / 2;
+    struct steal_task second = {.src = src, .other = other, .dst = halves, .lo = mid, .hi = hi};
+    steal_fork(worker, &second);
+    steal_sort(worker, src, other, halves, lo, mid);
+    steal_join(worker, &second);
+    steal_merge(worker, halves + lo, mid - lo, halves + mid, hi - mid, dst + lo);
+}
+
+void steal_run(struct steal_worker *worker, struct steal_task *task)
+{
+    if (task->is_merge)
+        steal_merge(worker, task->left, task->n1, task->right, task->n2, task->out);
+    else
+        steal_sort(worker, task->src, task->other, task->dst, task->lo, task->hi);
+    atomic_store_explicit(&task->done, true, memory_order_release);
 }
 
-// Calculate execution time of sorting
-double calculate_execution_time_sort(int *array, int array_size, int num_threads)
+// Thread function for a worker that only steals until the sort is finished
+void *steal_worker_thread(void *_args)
+{
+    struct steal_worker *worker = (struct steal_worker *)_args;
+    while (!atomic_load(&worker->pool->finished))
+    {
+        struct steal_task *task = steal_find(worker);
+        if (task != NULL)
+            steal_run(worker, task);
+        else
+            sched_yield();
+    }
+
+    pthread_exit(NULL);
+}
+
+/* Function to sort an array with a pool of work-stealing threads. The
+   calling thread is worker 0 and runs the root task */
+void work_stealing_sort(int *array, int *scratch, int array_size, int num_threads)
+{
+    struct steal_pool pool;
+    pool.workers = aligned_alloc(64, num_threads * sizeof(struct steal_worker));
+    assert(pool.workers != NULL);
+    pool.num_workers = num_threads;
+    atomic_init(&pool.finished, false);
+    for (int thread = 0; thread < num_threads; thread++)
+    {
+        struct steal_worker *worker = &pool.workers[thread];
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->top = worker->bottom = 0;
+        worker->id = thread;
+        worker->pool = &pool;
+    }
+    for (int thread = 1; thread < num_threads; thread++)
+        assert(pthread_create(&pool.workers[thread].thread, NULL, steal_worker_thread, &pool.workers[thread]) == 0);
+
+    steal_sort(&pool.workers[0], array, scratch, array, 0, array_size);
+
+    atomic_store(&pool.finished, true);
+    for (int thread = 1; thread < num_threads; thread++)
+        pthread_join(pool.workers[thread].thread, NULL);
+    for (int thread = 0; thread < num_threads; thread++)
+        pthread_mutex_destroy(&pool.workers[thread].lock);
+    free(pool.workers);
+}
+
+/* Calculate execution time of sorting. The scratch buffer is allocated
+   and touched before the clock starts, so that neither malloc nor the
+   first page faults on it are timed */
+double calculate_execution_time_sort(int *array, int array_size, int num_threads, enum sort_mode mode)
 {
     struct timeval start, end;
+    int *scratch = malloc(array_size * sizeof(int));
+    assert(scratch != NULL);
+    memset(scratch, 0, array_size * sizeof(int));
     gettimeofday(&start, NULL);
-    multicore_processing_sort(array, array_size, num_threads);
+    if (mode == SORT_STEAL)
+        work_stealing_sort(array, scratch, array_size, num_threads);
+    else
+        multicore_processing_sort(array, scratch, array_size, num_threads);
+    DO_NOT_OPTIMIZE(array);
     gettimeofday(&end, NULL);
+    free(scratch);
     double time_taken = end.tv_sec + end.tv_usec / 1e6 -
                         start.tv_sec - start.tv_usec / 1e6; // in seconds
     return time_taken;
 }
 
+/* Sum of all elements, so the sort can be checked for lost or duplicated values */
+int64_t array_checksum(int *array, int array_size)
+{
+    int64_t sum = 0;
+    for (int i = 0; i < array_size; i++)
+        sum += array[i];
+    return sum;
+}
+
+/* The sorted array must be non-decreasing and keep the input's checksum */
+bool verify_sorted(const char *what, int *array, int array_size, int64_t checksum)
+{
+    bool sorted = true;
+    for (int i = 1; i < array_size && sorted; i++)
+        sorted = array[i - 1] <= array[i];
+    return verify(what, sorted && array_checksum(array, array_size) == checksum);
+}
+
 // Calculate score of sorting
 int calculate_score_sort(int *array, int array_size, double execution_time)
 {
@@ -226,6 +915,255 @@ int calculate_score_sort(int *array, int array_size, double execution_time)
     return round(multi_core_score);
 }
 
+/* Integer sort: LSD radix sort on 8-bit digits, least significant
+   first, of 32- or 64-bit signed keys. Every pass counts digits per
+   thread slice, turns the counts into scatter offsets and moves every key
+   once, so the sort is bound by memory bandwidth, not by comparisons.
+   Passes whose digit is the same in every key are skipped */
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+/* Keys are staged per bucket and written out a whole aligned cache line
+   at a time with non-temporal stores, which go to memory through the
+   write-combining buffers without first reading the line into the cache */
+#define RADIX_LINE_BYTES 64
+
+struct radix_sort
+{
+    const void *src;
+    void *dst;
+    int64_t n;
+    int width; /* key bytes, 4 or 8 */
+    int shift; /* of the current digit */
+    int num_threads;
+    int64_t (*counts)[RADIX_BUCKETS]; /* digit counts of each thread's slice */
+};
+
+struct radix_slice
+{
+    struct radix_sort *sort;
+    int thread;
+    int64_t start;
+    int64_t end;
+};
+
+/* Digit of key i; the sign bit is flipped so negative keys sort first */
+static inline unsigned radix_digit(const void *keys, int64_t i, int width, int shift)
+{
+    uint64_t key = width == 4 ? (uint32_t)((const int32_t *)keys)[i] ^ 0x80000000U
+                              : (uint64_t)((const int64_t *)keys)[i] ^ 0x8000000000000000ULL;
+    return (key >> shift) & (RADIX_BUCKETS - 1);
+}
+
+static inline void radix_count(struct radix_slice *slice, int width)
+{
+    struct radix_sort *sort = slice->sort;
+    int64_t *counts = sort->counts[slice->thread];
+    memset(counts, 0, RADIX_BUCKETS * sizeof(int64_t));
+    for (int64_t i = slice->start; i < slice->end; i++)
+        counts[radix_digit(sort->src, i, width, sort->shift)]++;
+}
+
+/* Write a staged line out; only a full aligned line can bypass the cache */
+static inline void radix_flush(char *dst, const unsigned char *line, int bytes)
+{
+#if defined(__SSE2__)
+    if (bytes == RADIX_LINE_BYTES)
+    {
+        const __m128i *from = (const __m128i *)line;
+        __m128i *to = (__m128i *)dst;
+        for (int i = 0; i < RADIX_LINE_BYTES / 16; i++)
+            _mm_stream_si128(to + i, _mm_load_si128(from + i));
+        return;
+    }
+#endif
+    memcpy(dst, line, bytes);
+}
+
+static inline void radix_scatter(struct radix_slice *slice, int width)
+{
+    struct radix_sort *sort = slice->sort;
+    int per_line = RADIX_LINE_BYTES / width;
+
+    /* This thread's keys of bucket b go after all keys of smaller buckets
+       and after the bucket b keys of the threads before it */
+    int64_t offset[RADIX_BUCKETS];
+    int64_t base = 0;
+    for (int b = 0; b < RADIX_BUCKETS; b++)
+    {
+        offset[b] = base;
+        for (int t = 0; t < sort->num_threads; t++)
+        {
+            if (t == slice->thread)
+                offset[b] = base;
+            base += sort->counts[t][b];
+        }
+    }
+
+    /* Each bucket first collects up to the next line boundary of its
+       output, after that whole lines */
+    unsigned char line[RADIX_BUCKETS][RADIX_LINE_BYTES] __attribute__((aligned(64)));
+    int fill[RADIX_BUCKETS], limit[RADIX_BUCKETS];
+    char *dst = sort->dst;
+    const char *src = sort->src;
+    for (int b = 0; b < RADIX_BUCKETS; b++)
+    {
+        fill[b] = 0;
+        limit[b] = (RADIX_LINE_BYTES - (uintptr_t)(dst + offset[b] * width) % RADIX_LINE_BYTES) / width;
+    }
+    for (int64_t i = slice->start; i < slice->end; i++)
+    {
+        unsigned b = radix_digit(src, i, width, sort->shift);
+        memcpy(line[b] + fill[b] * width, src + i * width, width);
+        if (++fill[b] == limit[b])
+        {
+            radix_flush(dst + offset[b] * width, line[b], limit[b] * width);
+            offset[b] += limit[b];
+            fill[b] = 0;
+            limit[b] = per_line;
+        }
+    }
+    for (int b = 0; b < RADIX_BUCKETS; b++)
+        memcpy(dst + offset[b] * width, line[b], fill[b] * width);
+#if defined(__SSE2__)
+    _mm_sfence();
+#endif
+}
+
+// Thread function for counting the digits of a slice
+void *radix_count_thread(void *_args)
+{
+    struct radix_slice *slice = (struct radix_slice *)_args;
+    if (slice->sort->width == 4)
+        radix_count(slice, 4);
+    else
+        radix_count(slice, 8);
+
+    pthread_exit(NULL);
+}
+
+// Thread function for scattering a slice into the other buffer
+void *radix_scatter_thread(void *_args)
+{
+    struct radix_slice *slice = (struct radix_slice *)_args;
+    if (slice->sort->width == 4)
+        radix_scatter(slice, 4);
+    else
+        radix_scatter(slice, 8);
+
+    pthread_exit(NULL);
+}
+
+/* Run one phase of a pass on every thread's slice */
+void radix_phase(struct radix_sort *sort, void *(*phase)(void *))
+{
+    pthread_t threads[sort->num_threads];
+    struct radix_slice slices[sort->num_threads];
+    for (int thread = 0; thread < sort->num_threads; thread++)
+    {
+        slices[thread].sort = sort;
+        slices[thread].thread = thread;
+        slices[thread].start = sort->n * thread / sort->num_threads;
+        slices[thread].end = sort->n * (thread + 1) / sort->num_threads;
+        assert(pthread_create(&threads[thread], NULL, phase, &slices[thread]) == 0);
+    }
+    for (int thread = 0; thread < sort->num_threads; thread++)
+        pthread_join(threads[thread], NULL);
+}
+
+/* Function to radix sort n keys of width bytes with multiple threads.
+   A digit that is the same in every key needs no pass, so the work, and
+   the integer sort score, depend on the range of the keys as much as on
+   their width. Returns the number of digit passes that ran */
+int multicore_processing_radix_sort(void *keys, void *scratch, int64_t n, int width, int num_threads)
+{
+    int passes = 0;
+    int64_t counts[num_threads][RADIX_BUCKETS];
+    struct radix_sort sort = {keys, scratch, n, width, 0, num_threads, counts};
+    for (sort.shift = 0; sort.shift < 8 * width; sort.shift += RADIX_BITS)
+    {
+        radix_phase(&sort, radix_count_thread);
+
+        bool constant = false;
+        for (int b = 0; b < RADIX_BUCKETS && !constant; b++)
+        {
+            int64_t total = 0;
+            for (int t = 0; t < num_threads; t++)
+                total += counts[t][b];
+            constant = total == n;
+        }
+        if (constant)
+            continue;
+
+        radix_phase(&sort, radix_scatter_thread);
+        void *t = sort.dst;
+        sort.dst = (void *)sort.src;
+        sort.src = t;
+        passes++;
+    }
+
+    // An odd number of passes leaves the result in scratch
+    if (sort.src != keys)
+        memcpy(keys, sort.src, n * width);
+    return passes;
+}
+
+/* Calculate execution time of the integer sort; as for the comparison
+   sort, the scratch buffer is set up before the clock starts. The digit
+   passes that ran go to passes */
+double calculate_execution_time_integer_sort(void *keys, int64_t n, int width, int num_threads, int *passes)
+{
+    struct timeval start, end;
+    void *scratch = malloc(n * width);
+    assert(scratch != NULL);
+    memset(scratch, 0, n * width);
+    gettimeofday(&start, NULL);
+    *passes = multicore_processing_radix_sort(keys, scratch, n, width, num_threads);
+    DO_NOT_OPTIMIZE(keys);
+    gettimeofday(&end, NULL);
+    free(scratch);
+    double time_taken = end.tv_sec + end.tv_usec / 1e6 -
+                        start.tv_sec - start.tv_usec / 1e6; // in seconds
+    return time_taken;
+}
+
+/* Fill keys with the benchmark's values, returning their sum */
+int64_t fill_integer_keys(void *keys, int64_t n, int width)
+{
+    int64_t sum = 0;
+    for (int64_t i = 0; i < n; i++)
+    {
+        int value = rand() % 1000;
+        if (width == 4)
+            ((int32_t *)keys)[i] = value;
+        else
+            ((int64_t *)keys)[i] = value;
+        sum += value;
+    }
+    return sum;
+}
+
+bool verify_integer_sorted(const char *what, const void *keys, int64_t n, int width, int64_t checksum)
+{
+    bool sorted = true;
+    int64_t sum = 0;
+    for (int64_t i = 0; i < n; i++)
+    {
+        int64_t key = width == 4 ? ((const int32_t *)keys)[i] : ((const int64_t *)keys)[i];
+        int64_t previous = i == 0 ? key : width == 4 ? ((const int32_t *)keys)[i - 1] : ((const int64_t *)keys)[i - 1];
+        sorted = sorted && previous <= key;
+        sum += key;
+    }
+    return verify(what, sorted && sum == checksum);
+}
+
+/* Same scale as the comparison sort score, so the two read side by side */
+int calculate_score_integer_sort(int64_t n, double execution_time)
+{
+    int multi_core_score = (n / execution_time) / (666 * 4.75 * 1.2);
+    return round(multi_core_score);
+}
+
 /* Thread function for counting primes */
 void *
 prime_check(void *_args)
@@ -408,10 +1346,56 @@ size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
     return size * nmemb;
 }
 
+void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-m mode] [-k bits] [-i isa]\n", program);
+    fprintf(stderr, "  -m mode  multicore sort: steal (fork-join tasks on work-stealing deques) or\n");
+    fprintf(stderr, "           static (one slice per thread, then a parallel merge) (default steal)\n");
+    fprintf(stderr, "  -k bits  key width of the integer (radix) sort, 32 or 64 (default 32); the keys\n");
+    fprintf(stderr, "           stay in 0..999 and passes over digits that are the same in every key\n");
+    fprintf(stderr, "           are skipped, so both widths run 2 passes and differ in bytes moved only\n");
+    fprintf(stderr, "  -i isa   cap the sort kernels at scalar, avx2 or avx512 (default: best available)\n");
+    fprintf(stderr, "Runs with any option are reported locally and not uploaded.\n");
+    exit(EXIT_FAILURE);
+}
+
 int main(int argc, char **argv)
 {
     int64_t digits_e = 20000000000L;
     int64_t digits_prime = 50000000L;
+    bool upload = true;
+    int key_width = 4;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:k:i:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            if (strcmp(optarg, sort_mode_names[SORT_STEAL]) == 0)
+                sort_mode = SORT_STEAL;
+            else if (strcmp(optarg, sort_mode_names[SORT_STATIC]) == 0)
+                sort_mode = SORT_STATIC;
+            else
+                usage(argv[0]);
+            break;
+        case 'k':
+            if (strcmp(optarg, "32") == 0)
+                key_width = 4;
+            else if (strcmp(optarg, "64") == 0)
+                key_width = 8;
+            else
+                usage(argv[0]);
+            break;
+        case 'i':
+            if (strcmp(optarg, "scalar") != 0 && strcmp(optarg, "avx2") != 0 && strcmp(optarg, "avx512") != 0)
+                usage(argv[0]);
+            sort_isa = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+        upload = false;
+    }
     srand(time(NULL));
     int processes;
     char cpu_model[256];
@@ -580,6 +1564,7 @@ int main(int argc, char **argv)
     {
         array[i] = rand() % 1000;
     }
+    int64_t checksum = array_checksum(array, ARRAY_SIZE);
 
     // double execution_time_single_core_e = calculate_execution_time_e(digits_e, 1);
     // double execution_time_multi_core_e = calculate_execution_time_e(digits_e, processes);
@@ -594,22 +1579,44 @@ int main(int argc, char **argv)
     // int64_t score_single_core = (score_single_core_e + score_single_core_prime) / 2;
     // int64_t score_multi_core = (score_multi_core_e + score_multi_core_prime) / 2;
 
-    printf("Starting benchmark...\n");
+    sort_kernel_init();
+    printf("Starting benchmark (%s sort, %s kernels)...\n", sort_mode_names[sort_mode], sort_isa);
     printf("Starting single core...\n");
-    double execution_time_single_core = calculate_execution_time_sort(array, ARRAY_SIZE, 1);
+    double execution_time_single_core = calculate_execution_time_sort(array, ARRAY_SIZE, 1, sort_mode);
     printf("Ending single core...\n");
     int *array2 = malloc(ARRAY_SIZE * sizeof(int));
     for (int i = 0; i < ARRAY_SIZE; i++)
     {
         array2[i] = rand() % 1000;
     }
+    int64_t checksum2 = array_checksum(array2, ARRAY_SIZE);
     printf("Starting multi core...\n");
-    double execution_time_multi_core = calculate_execution_time_sort(array2, ARRAY_SIZE, processes);
+    double execution_time_multi_core = calculate_execution_time_sort(array2, ARRAY_SIZE, processes, sort_mode);
     printf("Ending multi core...\n");
+    bool valid = verify_sorted("single core sort", array, ARRAY_SIZE, checksum);
+    valid = verify_sorted("multi core sort", array2, ARRAY_SIZE, checksum2) && valid;
     printf("Benchmark finished.\n");
     int64_t score_single_core = calculate_score_sort(array, ARRAY_SIZE, execution_time_single_core);
     int64_t score_multi_core = calculate_score_sort(array2, ARRAY_SIZE, execution_time_multi_core);
 
+    /* The integer sort gets fresh keys of the same values, reusing the
+       comparison sort's buffers when the keys are 32 bits wide */
+    free(array2);
+    void *keys = key_width == 4 ? (void *)array : malloc((int64_t)ARRAY_SIZE * key_width);
+    if (keys != array)
+        free(array);
+    printf("Starting integer sort (%d-bit keys)...\n", 8 * key_width);
+    int64_t key_checksum = fill_integer_keys(keys, ARRAY_SIZE, key_width);
+    int passes;
+    double execution_time_single_core_integer = calculate_execution_time_integer_sort(keys, ARRAY_SIZE, key_width, 1, &passes);
+    valid = verify_integer_sorted("single core integer sort", keys, ARRAY_SIZE, key_width, key_checksum) && valid;
+    key_checksum = fill_integer_keys(keys, ARRAY_SIZE, key_width);
+    double execution_time_multi_core_integer = calculate_execution_time_integer_sort(keys, ARRAY_SIZE, key_width, processes, &passes);
+    valid = verify_integer_sorted("multi core integer sort", keys, ARRAY_SIZE, key_width, key_checksum) && valid;
+    free(keys);
+    int64_t score_single_core_integer = calculate_score_integer_sort(ARRAY_SIZE, execution_time_single_core_integer);
+    int64_t score_multi_core_integer = calculate_score_integer_sort(ARRAY_SIZE, execution_time_multi_core_integer);
+
     printf("CPU Model%s", model_info);
     printf("\n");
     printf(os_display);
@@ -620,6 +1627,11 @@ int main(int argc, char **argv)
     printf("Speedup: %lf\n", execution_time_single_core / execution_time_multi_core);
     printf("Efficiency: %lf\n", (execution_time_single_core / execution_time_multi_core) / processes);
     printf("CPU utilization: %lf\n", 100 - (execution_time_multi_core / execution_time_single_core) * 100);
+    printf("Integer sort single core score: %ld\n", score_single_core_integer);
+    printf("Integer sort multi core score: %ld\n", score_multi_core_integer);
+    printf("Integer sort speedup: %lf\n", execution_time_single_core_integer / execution_time_multi_core_integer);
+    printf("Integer sort digit passes: %d of %d (the others are the same in every key)\n",
+           passes, 8 * key_width / RADIX_BITS);
 
     // Generate 32 digit hex key
     char key[33];
@@ -660,6 +1672,14 @@ int main(int argc, char **argv)
     char jsonString[1024];
     primeBenchmarkToJson(prime_benchmark, jsonString);
 
+    if (!valid)
+    {
+        printf("Result verification failed, run marked invalid and not uploaded\n");
+        return EXIT_FAILURE;
+    }
+    if (!upload)
+        return 0;
+
     // Server information
     const char *host = "taipan-benchmarks.vercel.app";
     const char *path = "/api/cpu-benchmarks";
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include "bignum.h"
+
+/* Multiplication benchmark for bignum.h: times one product at a range of
+   sizes and reports limb multiplies per second, counting an na by nb
+   product as the na * nb limb products schoolbook would do. That makes
+   the rates of all sizes comparable, and the faster kernels show up as
+   rates far above what any core can do one limb product at a time.
+   Results are printed locally only */
+
+/* Optimization barrier: the compiler has to assume value is read and
+   changed here, so the work that produced it cannot be dropped or
+   folded away */
+#define DO_NOT_OPTIMIZE(value) __asm__ volatile("" : "+g"(value) : : "memory")
+
+/* Each size is multiplied again and again for at least this long */
+#define MIN_TIME 0.5
+
+/* Products are checked modulo this prime, 2^61 - 1 */
+#define CHECK_PRIME 2305843009213693951ULL
+
+/* Printed name of each enum bn_mul_method */
+const char *bn_mul_method_names[] = {"schoolbook", "karatsuba", "toom3", "ntt", "unbalanced"};
+
+/* Print a verification line and return whether it passed */
+bool verify(const char *what, bool passed)
+{
+    printf("Verification of %s: %s\n", what, passed ? "passed" : "FAILED");
+    return passed;
+}
+
+uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+uint64_t next_random(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/* A random n-limb number whose top limb is not zero */
+void random_bignum(struct bignum *x, size_t n)
+{
+    bn_reserve(x, n);
+    for (size_t i = 0; i < n; i++)
+        x->limb[i] = next_random() % BN_BASE;
+    if (x->limb[n - 1] == 0)
+        x->limb[n - 1] = 1;
+    x->size = n;
+    x->sign = 1;
+}
+
+/* |x| mod CHECK_PRIME by Horner's rule from the top limb */
+uint64_t residue(const struct bignum *x)
+{
+    unsigned __int128 r = 0;
+    for (size_t i = x->size; i-- > 0;)
+        r = (r * BN_BASE + x->limb[i]) % CHECK_PRIME;
+    return (uint64_t)r;
+}
+
+/* The product has to agree with the product of the residues */
+bool verify_product(const char *what, const struct bignum *a, const struct bignum *b, const struct bignum *r)
+{
+    uint64_t expected = (unsigned __int128)residue(a) * residue(b) % CHECK_PRIME;
+    return verify(what, r->size >= a->size + b->size - 1 && residue(r) == expected);
+}
+
+/* Seconds per product of an na by nb multiplication */
+double calculate_execution_time(const struct bignum *a, const struct bignum *b, struct bignum *r)
+{
+    struct timeval start, end;
+    double time_taken;
+    int64_t products = 0;
+    gettimeofday(&start, NULL);
+    do
+    {
+        bn_mul(r, a, b);
+        DO_NOT_OPTIMIZE(r->limb);
+        products++;
+        gettimeofday(&end, NULL);
+        time_taken = end.tv_sec + end.tv_usec / 1e6 -
+                     start.tv_sec - start.tv_usec / 1e6; // in seconds
+    } while (time_taken < MIN_TIME);
+    return time_taken / products;
+}
+
+void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-m limbs] [-u]\n", program);
+    fprintf(stderr, "  -m limbs  largest operand size, in limbs of 9 digits (default 1000000)\n");
+    fprintf(stderr, "  -u        unbalanced products: the second operand is a tenth of the first\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_limbs = 1000000;
+    bool unbalanced = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:u")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            max_limbs = strtoull(optarg, NULL, 10);
+            if (max_limbs < 1 || max_limbs > BN_NTT_MAX_LIMBS / 2)
+                usage(argv[0]);
+            break;
+        case 'u':
+            unbalanced = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    printf("Thresholds: karatsuba %d, toom3 %d, ntt %d limbs\n",
+           BN_KARATSUBA_THRESHOLD, BN_TOOM3_THRESHOLD, BN_NTT_THRESHOLD);
+    printf("%10s %10s %-11s %14s %18s\n", "limbs", "by", "method", "seconds", "limb mults/s");
+
+    struct bignum a, b, r;
+    bn_init(&a);
+    bn_init(&b);
+    bn_init(&r);
+    bool valid = true;
+    /* Sizes 10, 30, 100, 300, ... up to max_limbs */
+    for (size_t n = 10, step = 0; n <= max_limbs; n = step % 2 ? n * 10 / 3 : n * 3, step++)
+    {
+        size_t nb = unbalanced ? n / 10 : n;
+        random_bignum(&a, n);
+        random_bignum(&b, nb);
+        double execution_time = calculate_execution_time(&a, &b, &r);
+        printf("%10zu %10zu %-11s %14.9f %18.6e\n", n, nb, bn_mul_method_names[bn_mul_method(n, nb)],
+               execution_time, (double)n * nb / execution_time);
+        char what[64];
+        snprintf(what, sizeof(what), "%zu by %zu limbs", n, nb);
+        valid = verify_product(what, &a, &b, &r) && valid;
+    }
+
+    bn_free(&a);
+    bn_free(&b);
+    bn_free(&r);
+    return valid ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,1068 @@
+/* Arbitrary-precision integers for the digit benchmarks (pi, e).
+
+   Numbers are stored as little-endian limbs in base 10^9, so printing
+   decimal digits is a plain walk over the limbs and needs no radix
+   conversion. A uint64_t holds a limb product plus a limb and a carry,
+   which keeps the schoolbook kernel free of 128-bit arithmetic.
+
+   Multiplication is schoolbook below BN_KARATSUBA_THRESHOLD limbs, then
+   Karatsuba, Toom-3 from BN_TOOM3_THRESHOLD and a three-prime
+   number-theoretic transform from BN_NTT_THRESHOLD. The NTT is parallel
+   over its three primes only, so a product uses at most three threads
+   however many cores there are: the caller and two pool workers.
+   Division and square roots use Newton iterations built from
+   multiplications only, so they get the same asymptotic speed.
+
+   Everything here is static inline so a benchmark can include this
+   file directly, still build from one source file, and not be warned
+   about the helpers it does not use. */
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#define BN_BASE 1000000000U
+#define BN_BASE_DIGITS 9
+
+/* Below this many limbs in the smaller operand schoolbook beats Karatsuba */
+#define BN_KARATSUBA_THRESHOLD 40
+
+/* From this many limbs in the smaller operand Toom-3 beats Karatsuba */
+#define BN_TOOM3_THRESHOLD 250
+
+/* From this many limbs in the smaller operand the NTT beats Toom-3 */
+#define BN_NTT_THRESHOLD 4000
+
+/* Longest NTT product in limbs: the transform length of the smallest of
+   the three primes, 2^23 */
+#define BN_NTT_MAX_LIMBS (1U << 23)
+
+struct bignum
+{
+    uint32_t *limb;  /* little-endian base 10^9 digits */
+    size_t size;     /* limbs in use; the top one is never zero */
+    size_t capacity; /* limbs allocated */
+    int sign;        /* 1 or -1; zero has size 0 and sign 1 */
+};
+
+static inline void *bn_alloc(size_t bytes)
+{
+    void *p = malloc(bytes ? bytes : 1);
+    if (p == NULL)
+    {
+        fprintf(stderr, "bignum: out of memory allocating %zu bytes\n", bytes);
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+/* ---- Magnitudes: raw limb arrays, all sizes in limbs ---- */
+
+static inline size_t bn_mag_trim(const uint32_t *a, size_t n)
+{
+    while (n > 0 && a[n - 1] == 0)
+        n--;
+    return n;
+}
+
+static inline int bn_mag_cmp(const uint32_t *a, size_t na, const uint32_t *b, size_t nb)
+{
+    if (na != nb)
+        return na < nb ? -1 : 1;
+    for (size_t i = na; i-- > 0;)
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    return 0;
+}
+
+/* r = a + b, na >= nb; r has room for na + 1 limbs, returns the size */
+static inline size_t bn_mag_add(uint32_t *r, const uint32_t *a, size_t na, const uint32_t *b, size_t nb)
+{
+    uint32_t carry = 0;
+    size_t i;
+    for (i = 0; i < nb; i++)
+    {
+        uint32_t s = a[i] + b[i] + carry;
+        carry = s >= BN_BASE;
+        r[i] = carry ? s - BN_BASE : s;
+    }
+    for (; i < na; i++)
+    {
+        uint32_t s = a[i] + carry;
+        carry = s >= BN_BASE;
+        r[i] = carry ? s - BN_BASE : s;
+    }
+    r[na] = carry;
+    return na + carry;
+}
+
+/* r[0, nr) += a[0, na), nr >= na; a carry out of r is dropped, callers
+   size r so that none happens */
+static inline void bn_mag_add_in_place(uint32_t *r, size_t nr, const uint32_t *a, size_t na)
+{
+    uint32_t carry = 0;
+    size_t i;
+    for (i = 0; i < na; i++)
+    {
+        uint32_t s = r[i] + a[i] + carry;
+        carry = s >= BN_BASE;
+        r[i] = carry ? s - BN_BASE : s;
+    }
+    for (; carry && i < nr; i++)
+    {
+        uint32_t s = r[i] + 1;
+        carry = s >= BN_BASE;
+        r[i] = carry ? 0 : s;
+    }
+}
+
+/* r[0, nr) -= a[0, na), requires r >= a */
+static inline void bn_mag_sub_in_place(uint32_t *r, size_t nr, const uint32_t *a, size_t na)
+{
+    uint32_t borrow = 0;
+    size_t i;
+    for (i = 0; i < na; i++)
+    {
+        uint32_t sub = a[i] + borrow;
+        borrow = r[i] < sub;
+        r[i] = borrow ? r[i] + BN_BASE - sub : r[i] - sub;
+    }
+    for (; borrow && i < nr; i++)
+    {
+        borrow = r[i] == 0;
+        r[i] = borrow ? BN_BASE - 1 : r[i] - 1;
+    }
+}
+
+/* r[0, na + nb) = a * b by columns: the limb products of column k are
+   summed and split into a limb and a carry once per column, not once per
+   product. A product is below 10^18 < 2^64 / 16, so runs of 16 add up in
+   a plain uint64_t, which the compiler can vectorize */
+static inline void bn_mag_mul_basecase(uint32_t *r, const uint32_t *a, size_t na, const uint32_t *b, size_t nb)
+{
+    unsigned __int128 carry = 0;
+    for (size_t k = 0; k < na + nb - 1; k++)
+    {
+        size_t i = k < nb ? 0 : k - nb + 1;
+        size_t end = k < na ? k : na - 1;
+        unsigned __int128 column = carry;
+        while (i <= end)
+        {
+            size_t stop = end - i >= 16 ? i + 16 : end + 1;
+            uint64_t run = 0;
+            for (; i < stop; i++)
+                run += (uint64_t)a[i] * b[k - i];
+            column += run;
+        }
+        uint64_t high = (uint64_t)(column >> 32);
+        uint64_t low = (uint64_t)column & 0xffffffffU;
+        /* column / BN_BASE in two 64-bit steps, avoiding a 128-bit divide */
+        uint64_t q1 = high / BN_BASE;
+        uint64_t rest = ((high - q1 * BN_BASE) << 32) | low;
+        uint64_t q0 = rest / BN_BASE;
+        r[k] = (uint32_t)(rest - q0 * BN_BASE);
+        carry = ((unsigned __int128)q1 << 32) + q0;
+    }
+    r[na + nb - 1] = (uint32_t)carry;
+}
+
+static inline void bn_mag_mul(uint32_t *r, const uint32_t *a, size_t na, const uint32_t *b, size_t nb);
+static inline void bn_mag_mul_toom3(uint32_t *r, const uint32_t *a, size_t na, const uint32_t *b, size_t nb);
+static inline void bn_mag_mul_ntt(uint32_t *r, const uint32_t *a, size_t na, const uint32_t *b, size_t nb);
+
+/* Karatsuba for na >= nb > na / 2: with a = a1 B^h + a0 and
+   b = b1 B^h + b0, a b = z2 B^2h + (z1 - z2 - z0) B^h + z0 where
+   z1 = (a0 + a1)(b0 + b1), three half-size products instead of four */
+static inline void bn_mag_mul_karatsuba(uint32_t *r, const uint32_t *a, size_t na, const uint32_t *b, size_t nb)
+{
+    size_t h = (na + 1) / 2;
+    size_t na1 = na - h, nb1 = nb - h;
+
+    /* z0 and z2 go straight into the low and high halves of r */
+    bn_mag_mul(r, a, h, b, h);
+    if (nb1 > 0)
+        bn_mag_mul(r + 2 * h, a + h, na1, b + h, nb1);
+    else
+        memset(r + 2 * h, 0, (na1 + nb1) * sizeof(uint32_t));
+
+    uint32_t *scratch = bn_alloc((6 * h + 6) * sizeof(uint32_t));
+    uint32_t *sa = scratch, *sb = scratch + h + 1, *z1 = scratch + 2 * h + 2;
+    size_t nsa = bn_mag_add(sa, a, h, a + h, na1);
+    size_t nsb = nb1 > 0 ? bn_mag_add(sb, b, h, b + h, nb1) : (memcpy(sb, b, h * sizeof(uint32_t)), h);
+    nsa = bn_mag_trim(sa, nsa);
+    nsb = bn_mag_trim(sb, nsb);
+
+    size_t nz1 = nsa + nsb;
+    if (nsa == 0 || nsb == 0)
+        nz1 = 0;
+    else if (nsa >= nsb)
+        bn_mag_mul(z1, sa, nsa, sb, nsb);
+    else
+        bn_mag_mul(z1, sb, nsb, sa, nsa);
+    bn_mag_sub_in_place(z1, nz1, r, bn_mag_trim(r, 2 * h));
+    bn_mag_sub_in_place(z1, nz1, r + 2 * h, bn_mag_trim(r + 2 * h, na1 + nb1));
+    bn_mag_add_in_place(r + h, na + nb - h, z1, bn_mag_trim(z1, nz1));
+    free(scratch);
+}
+
+/* Which kernel bn_mag_mul uses for an na by nb product, na >= nb */
+enum bn_mul_method
+{
+    BN_MUL_BASECASE,
+    BN_MUL_KARATSUBA,
+    BN_MUL_TOOM3,
+    BN_MUL_NTT,
+    BN_MUL_UNBALANCED,
+};
+
+static inline enum bn_mul_method bn_mul_method(size_t na, size_t nb)
+{
+    if (nb < BN_KARATSUBA_THRESHOLD)
+        return BN_MUL_BASECASE;
+    if (nb >= BN_NTT_THRESHOLD && na + nb <= BN_NTT_MAX_LIMBS)
+        return BN_MUL_NTT;
+    if (2 * nb <= na)
+        return BN_MUL_UNBALANCED;
+    /* Toom-3 splits in thirds of a, and b has to reach into the top one */
+    if (nb >= BN_TOOM3_THRESHOLD && nb > 2 * ((na + 2) / 3))
+        return BN_MUL_TOOM3;
+    return BN_MUL_KARATSUBA;
+}
+
+/* r[0, na + nb) = a * b; r must not overlap a or b */
+static inline void bn_mag_mul(uint32_t *r, const uint32_t *a, size_t na, const uint32_t *b, size_t nb)
+{
+    if (na < nb)
+    {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        size_t n = na;
+        na = nb;
+        nb = n;
+    }
+    if (nb == 0)
+    {
+        memset(r, 0, na * sizeof(uint32_t));
+        return;
+    }
+    switch (bn_mul_method(na, nb))
+    {
+    case BN_MUL_BASECASE:
+        bn_mag_mul_basecase(r, a, na, b, nb);
+        break;
+    case BN_MUL_KARATSUBA:
+        bn_mag_mul_karatsuba(r, a, na, b, nb);
+        break;
+    case BN_MUL_TOOM3:
+        bn_mag_mul_toom3(r, a, na, b, nb);
+        break;
+    case BN_MUL_NTT:
+        bn_mag_mul_ntt(r, a, na, b, nb);
+        break;
+    case BN_MUL_UNBALANCED:
+    {
+        /* Multiply b by nb-limb slices of a and add them up */
+        uint32_t *part = bn_alloc(2 * nb * sizeof(uint32_t));
+        memset(r, 0, (na + nb) * sizeof(uint32_t));
+        for (size_t i = 0; i < na; i += nb)
+        {
+            size_t n = na - i < nb ? na - i : nb;
+            bn_mag_mul(part, b, nb, a + i, n);
+            bn_mag_add_in_place(r + i, na + nb - i, part, n + nb);
+        }
+        free(part);
+        break;
+    }
+    }
+}
+
+/* ---- Signed numbers ---- */
+
+static inline void bn_init(struct bignum *x)
+{
+    x->limb = NULL;
+    x->size = 0;
+    x->capacity = 0;
+    x->sign = 1;
+}
+
+static inline void bn_free(struct bignum *x)
+{
+    free(x->limb);
+    bn_init(x);
+}
+
+static inline void bn_reserve(struct bignum *x, size_t capacity)
+{
+    if (x->capacity >= capacity)
+        return;
+    uint32_t *limb = bn_alloc(capacity * sizeof(uint32_t));
+    if (x->size > 0)
+        memcpy(limb, x->limb, x->size * sizeof(uint32_t));
+    free(x->limb);
+    x->limb = limb;
+    x->capacity = capacity;
+}
+
+static inline void bn_swap(struct bignum *a, struct bignum *b)
+{
+    struct bignum t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static inline void bn_normalize(struct bignum *x)
+{
+    x->size = bn_mag_trim(x->limb, x->size);
+    if (x->size == 0)
+        x->sign = 1;
+}
+
+static inline void bn_set_u64(struct bignum *x, uint64_t v)
+{
+    bn_reserve(x, 3);
+    x->size = 0;
+    x->sign = 1;
+    while (v > 0)
+    {
+        x->limb[x->size++] = v % BN_BASE;
+        v /= BN_BASE;
+    }
+}
+
+static inline void bn_set_i64(struct bignum *x, int64_t v)
+{
+    bn_set_u64(x, v < 0 ? -(uint64_t)v : (uint64_t)v);
+    x->sign = v < 0 && x->size > 0 ? -1 : 1;
+}
+
+static inline void bn_copy(struct bignum *r, const struct bignum *a)
+{
+    if (r == a)
+        return;
+    bn_reserve(r, a->size);
+    if (a->size > 0)
+        memcpy(r->limb, a->limb, a->size * sizeof(uint32_t));
+    r->size = a->size;
+    r->sign = a->sign;
+}
+
+static inline bool bn_is_zero(const struct bignum *a)
+{
+    return a->size == 0;
+}
+
+/* Compare values, signs included */
+static inline int bn_cmp(const struct bignum *a, const struct bignum *b)
+{
+    if (a->sign != b->sign)
+        return a->sign < b->sign ? -1 : 1;
+    return a->sign * bn_mag_cmp(a->limb, a->size, b->limb, b->size);
+}
+
+/* r = a * b; r may be a or b */
+static inline void bn_mul(struct bignum *r, const struct bignum *a, const struct bignum *b)
+{
+    struct bignum t;
+    bn_init(&t);
+    if (a->size > 0 && b->size > 0)
+    {
+        bn_reserve(&t, a->size + b->size);
+        bn_mag_mul(t.limb, a->limb, a->size, b->limb, b->size);
+        t.size = a->size + b->size;
+        t.sign = a->sign * b->sign;
+        bn_normalize(&t);
+    }
+    bn_swap(r, &t);
+    bn_free(&t);
+}
+
+/* r = a * m for a small factor; r may be a */
+static inline void bn_mul_u32(struct bignum *r, const struct bignum *a, uint32_t m)
+{
+    bn_copy(r, a);
+    bn_reserve(r, r->size + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < r->size; i++)
+    {
+        uint64_t t = (uint64_t)r->limb[i] * m + carry;
+        carry = t / BN_BASE;
+        r->limb[i] = (uint32_t)(t - carry * BN_BASE);
+    }
+    r->limb[r->size++] = (uint32_t)carry;
+    bn_normalize(r);
+}
+
+/* r = a / d truncated toward zero, returns the remainder's magnitude;
+   r may be a */
+static inline uint32_t bn_div_u32(struct bignum *r, const struct bignum *a, uint32_t d)
+{
+    bn_copy(r, a);
+    uint64_t rem = 0;
+    for (size_t i = r->size; i-- > 0;)
+    {
+        uint64_t cur = rem * BN_BASE + r->limb[i];
+        r->limb[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    bn_normalize(r);
+    return (uint32_t)rem;
+}
+
+/* r = a + b_sign * |b|; r may be a or b */
+static inline void bn_add_signed(struct bignum *r, const struct bignum *a, const struct bignum *b, int b_sign)
+{
+    struct bignum t;
+    bn_init(&t);
+    bn_reserve(&t, (a->size > b->size ? a->size : b->size) + 1);
+    if (a->sign == b_sign)
+    {
+        if (a->size >= b->size)
+            t.size = bn_mag_add(t.limb, a->limb, a->size, b->limb, b->size);
+        else
+            t.size = bn_mag_add(t.limb, b->limb, b->size, a->limb, a->size);
+        t.sign = a->sign;
+    }
+    else
+    {
+        /* Subtract the smaller magnitude from the larger, keep its sign */
+        bool a_larger = bn_mag_cmp(a->limb, a->size, b->limb, b->size) >= 0;
+        const struct bignum *large = a_larger ? a : b;
+        const struct bignum *small = a_larger ? b : a;
+        if (large->size > 0)
+            memcpy(t.limb, large->limb, large->size * sizeof(uint32_t));
+        t.size = large->size;
+        bn_mag_sub_in_place(t.limb, t.size, small->limb, small->size);
+        t.sign = a_larger ? a->sign : b_sign;
+    }
+    bn_normalize(&t);
+    bn_swap(r, &t);
+    bn_free(&t);
+}
+
+/* r = a + b; r may be a or b */
+static inline void bn_add(struct bignum *r, const struct bignum *a, const struct bignum *b)
+{
+    bn_add_signed(r, a, b, b->sign);
+}
+
+/* r = a - b; r may be a or b */
+static inline void bn_sub(struct bignum *r, const struct bignum *a, const struct bignum *b)
+{
+    bn_add_signed(r, a, b, b->size > 0 ? -b->sign : 1);
+}
+
+/* r = a * BN_BASE^shift for shift >= 0, or a / BN_BASE^-shift truncated
+   toward zero for shift < 0; r may be a */
+static inline void bn_shift_limbs(struct bignum *r, const struct bignum *a, long shift)
+{
+    if (shift >= 0)
+    {
+        if (a->size == 0)
+        {
+            bn_set_u64(r, 0);
+            return;
+        }
+        struct bignum t;
+        bn_init(&t);
+        bn_reserve(&t, a->size + shift);
+        memset(t.limb, 0, shift * sizeof(uint32_t));
+        memcpy(t.limb + shift, a->limb, a->size * sizeof(uint32_t));
+        t.size = a->size + shift;
+        t.sign = a->sign;
+        bn_swap(r, &t);
+        bn_free(&t);
+        return;
+    }
+    size_t drop = (size_t)-shift;
+    bn_copy(r, a);
+    if (drop >= r->size)
+    {
+        r->size = 0;
+        r->sign = 1;
+        return;
+    }
+    memmove(r->limb, r->limb + drop, (r->size - drop) * sizeof(uint32_t));
+    r->size -= drop;
+}
+
+/* ---- Toom-3 and the number-theoretic transform ---- */
+
+/* A read-only bignum over n limbs of a magnitude, never to be written,
+   reserved or freed */
+static inline struct bignum bn_view(const uint32_t *limb, size_t n)
+{
+    struct bignum x = {(uint32_t *)limb, bn_mag_trim(limb, n), 0, 1};
+    return x;
+}
+
+/* v = x(1), x(-1), x(-2) for x(t) = x2 t^2 + x1 t + x0 */
+static inline void bn_toom3_evaluate(struct bignum v[3], const struct bignum *x0,
+                                     const struct bignum *x1, const struct bignum *x2)
+{
+    bn_add(&v[0], x0, x2);
+    bn_sub(&v[1], &v[0], x1);
+    bn_add(&v[0], &v[0], x1);
+    bn_add(&v[2], &v[1], x2);
+    bn_add(&v[2], &v[2], &v[2]);
+    bn_sub(&v[2], &v[2], x0);
+}
+
+/* Toom-3 for na >= nb > 2 ceil(na / 3): a and b become polynomials of
+   degree 2 in x = B^k, the product is sampled at 0, 1, -1, -2 and
+   infinity with five third-size products, and its five coefficients are
+   interpolated back with exact divisions by 2 and 3 (Bodrato's sequence) */
+static inline void bn_mag_mul_toom3(uint32_t *r, const uint32_t *a, size_t na, const uint32_t *b, size_t nb)
+{
+    size_t k = (na + 2) / 3;
+    struct bignum a0 = bn_view(a, k), a1 = bn_view(a + k, k), a2 = bn_view(a + 2 * k, na - 2 * k);
+    struct bignum b0 = bn_view(b, k), b1 = bn_view(b + k, k), b2 = bn_view(b + 2 * k, nb - 2 * k);
+    struct bignum va[3], vb[3], c[5], t;
+    bn_init(&t);
+    for (int i = 0; i < 3; i++)
+    {
+        bn_init(&va[i]);
+        bn_init(&vb[i]);
+    }
+    for (int i = 0; i < 5; i++)
+        bn_init(&c[i]);
+    bn_toom3_evaluate(va, &a0, &a1, &a2);
+    bn_toom3_evaluate(vb, &b0, &b1, &b2);
+
+    /* c[0] = r(0), c[1] = r(1), c[2] = r(-1), c[3] = r(-2), c[4] = r(inf) */
+    bn_mul(&c[0], &a0, &b0);
+    bn_mul(&c[1], &va[0], &vb[0]);
+    bn_mul(&c[2], &va[1], &vb[1]);
+    bn_mul(&c[3], &va[2], &vb[2]);
+    bn_mul(&c[4], &a2, &b2);
+
+    /* Interpolate in place: c[i] becomes the coefficient of x^i */
+    bn_sub(&c[3], &c[3], &c[1]);
+    bn_div_u32(&c[3], &c[3], 3);
+    bn_sub(&t, &c[1], &c[2]);
+    bn_div_u32(&t, &t, 2);
+    bn_sub(&c[2], &c[2], &c[0]);
+    bn_sub(&c[3], &c[2], &c[3]);
+    bn_div_u32(&c[3], &c[3], 2);
+    bn_add(&c[3], &c[3], &c[4]);
+    bn_add(&c[3], &c[3], &c[4]);
+    bn_add(&c[2], &c[2], &t);
+    bn_sub(&c[2], &c[2], &c[4]);
+    bn_sub(&c[1], &t, &c[3]);
+
+    /* Every coefficient is non-negative and fits under the product */
+    memset(r, 0, (na + nb) * sizeof(uint32_t));
+    for (int i = 0; i < 5; i++)
+        bn_mag_add_in_place(r + i * k, na + nb - i * k, c[i].limb, c[i].size);
+
+    bn_free(&t);
+    for (int i = 0; i < 3; i++)
+    {
+        bn_free(&va[i]);
+        bn_free(&vb[i]);
+    }
+    for (int i = 0; i < 5; i++)
+        bn_free(&c[i]);
+}
+
+/* The NTT multiplies limb for limb modulo three primes p = c 2^m + 1
+   with primitive root 3 and recovers each column sum by the Chinese
+   remainder theorem. A column adds at most 2^23 products below 10^18,
+   under 4.2e24, and the three primes multiply to 7.8e25. Residues stay
+   in Montgomery form, x 2^32 mod p, so that a modular product is two
+   32-bit multiplies and a shift instead of a 64-bit division */
+static const uint32_t bn_ntt_primes[3] = {998244353, 167772161, 469762049};
+
+struct bn_ntt_prime
+{
+    uint32_t p;
+    uint32_t p_inv; /* -1 / p mod 2^32 */
+    uint32_t r2;    /* 2^64 mod p */
+};
+
+/* t 2^-32 mod p for t < p 2^32 */
+static inline uint32_t bn_mont_reduce(const struct bn_ntt_prime *m, uint64_t t)
+{
+    uint32_t q = (uint32_t)t * m->p_inv;
+    uint32_t u = (uint32_t)((t + (uint64_t)q * m->p) >> 32);
+    return u >= m->p ? u - m->p : u;
+}
+
+static inline uint32_t bn_mont_mul(const struct bn_ntt_prime *m, uint32_t a, uint32_t b)
+{
+    return bn_mont_reduce(m, (uint64_t)a * b);
+}
+
+static inline uint32_t bn_mont_add(const struct bn_ntt_prime *m, uint32_t a, uint32_t b)
+{
+    uint32_t s = a + b;
+    return s >= m->p ? s - m->p : s;
+}
+
+static inline uint32_t bn_mont_sub(const struct bn_ntt_prime *m, uint32_t a, uint32_t b)
+{
+    return a >= b ? a - b : a + m->p - b;
+}
+
+static inline uint32_t bn_pow_mod(uint64_t x, uint64_t e, uint32_t p)
+{
+    uint64_t result = 1;
+    x %= p;
+    for (; e > 0; e >>= 1)
+    {
+        if (e & 1)
+            result = result * x % p;
+        x = x * x % p;
+    }
+    return (uint32_t)result;
+}
+
+static inline void bn_ntt_prime_init(struct bn_ntt_prime *m, uint32_t p)
+{
+    m->p = p;
+    uint32_t inv = p; /* Newton's iteration doubles the correct low bits */
+    for (int i = 0; i < 4; i++)
+        inv *= 2 - p * inv;
+    m->p_inv = -inv;
+    m->r2 = (uint32_t)(((unsigned __int128)1 << 64) % p);
+}
+
+/* Decimation in frequency: natural order in, bit-reversed order out.
+   w[j] is the n-th root of unity to the j, in Montgomery form */
+static inline void bn_ntt_forward(const struct bn_ntt_prime *m, uint32_t *x, size_t n, const uint32_t *w)
+{
+    for (size_t len = n; len >= 2; len >>= 1)
+    {
+        size_t half = len / 2, stride = n / len;
+        for (size_t s = 0; s < n; s += len)
+            for (size_t j = 0; j < half; j++)
+            {
+                uint32_t u = x[s + j], v = x[s + j + half];
+                x[s + j] = bn_mont_add(m, u, v);
+                x[s + j + half] = bn_mont_mul(m, bn_mont_sub(m, u, v), w[j * stride]);
+            }
+    }
+}
+
+/* Decimation in time with the inverse roots: bit-reversed order in,
+   natural order out, still to be divided by n */
+static inline void bn_ntt_inverse(const struct bn_ntt_prime *m, uint32_t *x, size_t n, const uint32_t *w)
+{
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        size_t half = len / 2, stride = n / len;
+        for (size_t s = 0; s < n; s += len)
+            for (size_t j = 0; j < half; j++)
+            {
+                uint32_t u = x[s + j], v = bn_mont_mul(m, x[s + j + half], w[j * stride]);
+                x[s + j] = bn_mont_add(m, u, v);
+                x[s + j + half] = bn_mont_sub(m, u, v);
+            }
+    }
+}
+
+/* One prime's share of a product: the cyclic convolution of a and b of
+   length n, left in out as plain residues */
+struct bn_ntt_job
+{
+    uint32_t p;
+    const uint32_t *a, *b;
+    size_t na, nb, n;
+    uint32_t *out;
+    /* Pool bookkeeping, under bn_ntt_pool.lock */
+    struct bn_ntt_job *next_queued;
+    bool queued, done;
+};
+
+static inline void bn_ntt_job_run(struct bn_ntt_job *job)
+{
+    struct bn_ntt_prime m;
+    bn_ntt_prime_init(&m, job->p);
+    size_t n = job->n;
+    bool square = job->a == job->b && job->na == job->nb;
+
+    /* Roots and inverse roots of unity of order n */
+    uint32_t *w = bn_alloc(n * sizeof(uint32_t));
+    uint32_t root = bn_pow_mod(3, (job->p - 1) / n, job->p);
+    uint32_t root_mont = bn_mont_mul(&m, root, m.r2);
+    uint32_t inverse_mont = bn_mont_mul(&m, bn_pow_mod(root, job->p - 2, job->p), m.r2);
+    w[0] = w[n / 2] = bn_mont_reduce(&m, m.r2);
+    for (size_t j = 1; j < n / 2; j++)
+    {
+        w[j] = bn_mont_mul(&m, w[j - 1], root_mont);
+        w[n / 2 + j] = bn_mont_mul(&m, w[n / 2 + j - 1], inverse_mont);
+    }
+
+    uint32_t *fa = job->out;
+    uint32_t *fb = square ? fa : bn_alloc(n * sizeof(uint32_t));
+    for (size_t i = 0; i < n; i++)
+        fa[i] = i < job->na ? bn_mont_mul(&m, job->a[i], m.r2) : 0;
+    bn_ntt_forward(&m, fa, n, w);
+    if (!square)
+    {
+        for (size_t i = 0; i < n; i++)
+            fb[i] = i < job->nb ? bn_mont_mul(&m, job->b[i], m.r2) : 0;
+        bn_ntt_forward(&m, fb, n, w);
+    }
+    for (size_t i = 0; i < n; i++)
+        fa[i] = bn_mont_mul(&m, fa[i], fb[i]);
+    bn_ntt_inverse(&m, fa, n, w + n / 2);
+
+    /* Multiplying a Montgomery residue by a plain 1 / n leaves it plain */
+    uint32_t n_inverse = bn_pow_mod(n, job->p - 2, job->p);
+    for (size_t i = 0; i < n; i++)
+        fa[i] = bn_mont_mul(&m, fa[i], n_inverse);
+
+    if (!square)
+        free(fb);
+    free(w);
+}
+
+/* Workers for the second and third prime of every NTT product. They are
+   started on the first product and kept for the life of the process, so
+   a product does not pay for thread creation. Products running at the
+   same time, as in binary splitting, share the workers through one
+   queue, and a caller runs its own jobs that no worker has taken yet */
+#define BN_NTT_WORKERS 2
+
+struct bn_ntt_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t work;     /* a job was queued */
+    pthread_cond_t finished; /* a queued job is done */
+    struct bn_ntt_job *queue;
+};
+
+static struct bn_ntt_pool bn_ntt_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                                         PTHREAD_COND_INITIALIZER, NULL};
+static pthread_once_t bn_ntt_pool_once = PTHREAD_ONCE_INIT;
+
+static inline void *bn_ntt_worker(void *unused)
+{
+    (void)unused;
+    pthread_mutex_lock(&bn_ntt_pool.lock);
+    for (;;)
+    {
+        while (bn_ntt_pool.queue == NULL)
+            pthread_cond_wait(&bn_ntt_pool.work, &bn_ntt_pool.lock);
+        struct bn_ntt_job *job = bn_ntt_pool.queue;
+        bn_ntt_pool.queue = job->next_queued;
+        job->queued = false;
+        pthread_mutex_unlock(&bn_ntt_pool.lock);
+        bn_ntt_job_run(job);
+        pthread_mutex_lock(&bn_ntt_pool.lock);
+        job->done = true;
+        pthread_cond_broadcast(&bn_ntt_pool.finished);
+    }
+    return NULL;
+}
+
+/* Without workers every job still runs, on the calling thread */
+static inline void bn_ntt_pool_start(void)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < BN_NTT_WORKERS; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, bn_ntt_worker, NULL) != 0)
+            fprintf(stderr, "bignum: could not start an NTT worker\n");
+    }
+    pthread_attr_destroy(&attr);
+}
+
+/* Wait for a queued job, running it here if no worker has taken it */
+static inline void bn_ntt_job_wait(struct bn_ntt_job *job)
+{
+    pthread_mutex_lock(&bn_ntt_pool.lock);
+    while (!job->done)
+    {
+        if (job->queued)
+        {
+            struct bn_ntt_job **link = &bn_ntt_pool.queue;
+            while (*link != job)
+                link = &(*link)->next_queued;
+            *link = job->next_queued;
+            job->queued = false;
+            pthread_mutex_unlock(&bn_ntt_pool.lock);
+            bn_ntt_job_run(job);
+            pthread_mutex_lock(&bn_ntt_pool.lock);
+            job->done = true;
+        }
+        else
+            pthread_cond_wait(&bn_ntt_pool.finished, &bn_ntt_pool.lock);
+    }
+    pthread_mutex_unlock(&bn_ntt_pool.lock);
+}
+
+static inline void bn_mag_mul_ntt(uint32_t *r, const uint32_t *a, size_t na, const uint32_t *b, size_t nb)
+{
+    size_t n = 1;
+    while (n < na + nb - 1)
+        n <<= 1;
+
+    /* One job per prime: the first runs on the calling thread, the other
+       two go to the pool */
+    struct bn_ntt_job jobs[3];
+    pthread_once(&bn_ntt_pool_once, bn_ntt_pool_start);
+    pthread_mutex_lock(&bn_ntt_pool.lock);
+    for (int i = 0; i < 3; i++)
+    {
+        jobs[i] = (struct bn_ntt_job){.p = bn_ntt_primes[i], .a = a, .b = b, .na = na, .nb = nb, .n = n,
+                                      .out = bn_alloc(n * sizeof(uint32_t))};
+        if (i > 0)
+        {
+            jobs[i].next_queued = bn_ntt_pool.queue;
+            jobs[i].queued = true;
+            bn_ntt_pool.queue = &jobs[i];
+        }
+    }
+    pthread_cond_broadcast(&bn_ntt_pool.work);
+    pthread_mutex_unlock(&bn_ntt_pool.lock);
+    bn_ntt_job_run(&jobs[0]);
+    for (int i = 1; i < 3; i++)
+        bn_ntt_job_wait(&jobs[i]);
+
+    /* Garner: column = x0 + p0 t1 + p0 p1 t2 with t1 < p1, t2 < p2 */
+    uint64_t p0 = bn_ntt_primes[0], p1 = bn_ntt_primes[1], p2 = bn_ntt_primes[2];
+    uint64_t p0_inverse = bn_pow_mod(p0, p1 - 2, p1);
+    uint64_t p01_inverse = bn_pow_mod(p0 * p1 % p2, p2 - 2, p2);
+    unsigned __int128 carry = 0;
+    for (size_t k = 0; k < na + nb - 1; k++)
+    {
+        uint64_t x0 = jobs[0].out[k], x1 = jobs[1].out[k], x2 = jobs[2].out[k];
+        uint64_t t1 = (x1 + p1 - x0 % p1) % p1 * p0_inverse % p1;
+        uint64_t low = x0 + p0 * t1;
+        uint64_t t2 = (x2 + p2 - low % p2) % p2 * p01_inverse % p2;
+        unsigned __int128 column = carry + low + (unsigned __int128)(p0 * p1) * t2;
+
+        uint64_t high = (uint64_t)(column >> 32);
+        uint64_t rest = (uint64_t)column & 0xffffffffU;
+        /* column / BN_BASE in two 64-bit steps, as in the schoolbook kernel */
+        uint64_t q1 = high / BN_BASE;
+        rest |= (high - q1 * BN_BASE) << 32;
+        uint64_t q0 = rest / BN_BASE;
+        r[k] = (uint32_t)(rest - q0 * BN_BASE);
+        carry = ((unsigned __int128)q1 << 32) + q0;
+    }
+    r[na + nb - 1] = (uint32_t)carry;
+
+    for (int i = 0; i < 3; i++)
+        free(jobs[i].out);
+}
+
+/* ---- Newton iterations ---- */
+
+/* y ~ BN_BASE^(m + p) / t for t > 0 of m limbs, good to a few units in
+   the last of its p + 1 limbs. Each step doubles the precision and only
+   reads the top p + 2 limbs of t. With the residual e = B^(m + h) - t y_h,
+   y_p = y_h B^(p - h) + y_h e / B^(m + 2h - p). The low m + h - p - 1
+   limbs of e stay below the last unit of y_p; for long t that is h + 1
+   limbs and the product shrinks to h by h */
+static inline void bn_reciprocal(struct bignum *y, const struct bignum *t, size_t p)
+{
+    size_t m = t->size;
+    if (p <= 2)
+    {
+        /* t ~ top * B^(m - 3) with top the leading three limbs, so
+           y ~ B^(p + 3) / top, from B^4 / top in 128-bit arithmetic */
+        unsigned __int128 top = 0;
+        for (size_t i = 0; i < 3; i++)
+            top = top * BN_BASE + (i < m ? t->limb[m - 1 - i] : 0);
+        unsigned __int128 b4 = (unsigned __int128)1000000000000000000ULL * 1000000000000000000ULL;
+        bn_set_u64(y, (uint64_t)(b4 / top));
+        bn_shift_limbs(y, y, (long)p - 1);
+        return;
+    }
+
+    size_t h = (p + 2) / 2;
+    struct bignum yh, tp, u;
+    bn_init(&yh);
+    bn_init(&tp);
+    bn_init(&u);
+    bn_reciprocal(&yh, t, h);
+
+    /* Truncating t to p + 2 limbs keeps y at the same scale */
+    size_t mp = m > p + 2 ? p + 2 : m;
+    bn_shift_limbs(&tp, t, -(long)(m - mp));
+
+    bn_mul(&u, &tp, &yh);
+    bn_set_u64(y, 1);
+    bn_shift_limbs(y, y, (long)(mp + h));
+    bn_sub(&u, y, &u);
+    long drop = mp + h > p + 1 ? (long)(mp + h - p - 1) : 0;
+    bn_shift_limbs(&u, &u, -drop);
+    bn_mul(&u, &u, &yh);
+    bn_shift_limbs(&u, &u, -(long)(mp + 2 * h - p - drop));
+    bn_shift_limbs(y, &yh, (long)(p - h));
+    bn_add(y, y, &u);
+
+    bn_free(&yh);
+    bn_free(&tp);
+    bn_free(&u);
+}
+
+/* q = floor(x / t) for x >= 0 and t > 0: multiply by the reciprocal,
+   then fix the last units with the exact remainder. The low m - 1 limbs
+   of x change that product by less than a unit, so they are dropped */
+static inline void bn_div(struct bignum *q, const struct bignum *x, const struct bignum *t)
+{
+    if (bn_mag_cmp(x->limb, x->size, t->limb, t->size) < 0)
+    {
+        bn_set_u64(q, 0);
+        return;
+    }
+    size_t p = x->size - t->size + 2;
+    struct bignum y, r, qt;
+    bn_init(&y);
+    bn_init(&r);
+    bn_init(&qt);
+    bn_reciprocal(&y, t, p);
+    bn_shift_limbs(&qt, x, -(long)(t->size - 1));
+    bn_mul(&qt, &qt, &y);
+    bn_shift_limbs(&qt, &qt, -(long)(p + 1));
+
+    bn_mul(&r, &qt, t);
+    bn_sub(&r, x, &r);
+    struct bignum one;
+    bn_init(&one);
+    bn_set_u64(&one, 1);
+    int corrections = 0;
+    while (r.sign < 0)
+    {
+        bn_sub(&qt, &qt, &one);
+        bn_add(&r, &r, t);
+        corrections++;
+    }
+    while (bn_cmp(&r, t) >= 0)
+    {
+        bn_add(&qt, &qt, &one);
+        bn_sub(&r, &r, t);
+        corrections++;
+    }
+    if (corrections > 16)
+        fprintf(stderr, "bignum: reciprocal was off by %d units\n", corrections);
+    bn_swap(q, &qt);
+
+    bn_free(&y);
+    bn_free(&r);
+    bn_free(&qt);
+    bn_free(&one);
+}
+
+/* z ~ BN_BASE^p / sqrt(a), good to a few units in the last limb:
+   z_p = z_h B^(p - h) (3 B^2h - a z_h^2) / (2 B^2h) */
+static inline void bn_inverse_sqrt_u32(struct bignum *z, uint32_t a, size_t p)
+{
+    if (p <= 2)
+    {
+        bn_set_u64(z, (uint64_t)((p == 1 ? 1e9 : 1e18) / sqrt((double)a)));
+        return;
+    }
+
+    size_t h = (p + 2) / 2;
+    struct bignum zh, e, three;
+    bn_init(&zh);
+    bn_init(&e);
+    bn_init(&three);
+    bn_inverse_sqrt_u32(&zh, a, h);
+
+    bn_mul(&e, &zh, &zh);
+    bn_mul_u32(&e, &e, a);
+    bn_set_u64(&three, 3);
+    bn_shift_limbs(&three, &three, (long)(2 * h));
+    bn_sub(&e, &three, &e);
+    bn_mul(z, &zh, &e);
+    bn_shift_limbs(z, z, -(long)(3 * h - p));
+    bn_div_u32(z, z, 2);
+
+    bn_free(&zh);
+    bn_free(&e);
+    bn_free(&three);
+}
+
+/* ---- Output ---- */
+
+/* Decimal digits of |a|, malloc'd and NUL-terminated */
+static inline char *bn_to_decimal(const struct bignum *a)
+{
+    char *s = bn_alloc(a->size * BN_BASE_DIGITS + 2);
+    if (a->size == 0)
+    {
+        strcpy(s, "0");
+        return s;
+    }
+    size_t n = sprintf(s, "%u", a->limb[a->size - 1]);
+    for (size_t i = a->size - 1; i-- > 0;)
+    {
+        uint32_t v = a->limb[i];
+        for (int d = BN_BASE_DIGITS - 1; d >= 0; d--)
+        {
+            s[n + d] = '0' + v % 10;
+            v /= 10;
+        }
+        n += BN_BASE_DIGITS;
+    }
+    s[n] = '\0';
+    return s;
+}
+
+/* FNV-1a over a digit string, for checking long results against known
+   hashes without storing the digits */
+static inline uint64_t bn_digits_hash(const char *digits, size_t n)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; i++)
+    {
+        hash ^= (unsigned char)digits[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* ---- Threads ---- */
+
+/* One product for a worker thread, so independent multiplications of a
+   binary splitting merge can run side by side */
+struct bn_mul_job
+{
+    struct bignum *r;
+    const struct bignum *a;
+    const struct bignum *b;
+    pthread_t thread;
+};
+
+static inline void *bn_mul_job_run(void *_job)
+{
+    struct bn_mul_job *job = (struct bn_mul_job *)_job;
+    bn_mul(job->r, job->a, job->b);
+    return NULL;
+}
+
+static inline void bn_mul_job_start(struct bn_mul_job *job, struct bignum *r,
+                                    const struct bignum *a, const struct bignum *b)
+{
+    job->r = r;
+    job->a = a;
+    job->b = b;
+    if (pthread_create(&job->thread, NULL, bn_mul_job_run, job) != 0)
+    {
+        fprintf(stderr, "bignum: could not start a multiplication thread\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static inline void bn_mul_job_wait(struct bn_mul_job *job)
+{
+    pthread_join(job->thread, NULL);
+}
+
+#endif
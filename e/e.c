@@ -14,8 +14,18 @@
 #include <arpa/inet.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <float.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#endif
+#include "../bignum/bignum.h"
 #define MAX_BUFFER_SIZE 1024
 
+/* Optimization barrier: the compiler has to assume value is read and
+   changed here, so the work that produced it cannot be dropped or
+   folded away */
+#define DO_NOT_OPTIMIZE(value) __asm__ volatile("" : "+g"(value) : : "memory")
+
 /* Each thread gets a start and end number and returns the number
    Of primes in that range */
 struct range
@@ -71,6 +81,13 @@ void primeBenchmarkToJson(struct prime_benchmark benchmark, char *jsonString)
             benchmark.time, benchmark.hostname, benchmark.key, benchmark.processes);
 }
 
+/* Print a verification line and return whether it passed */
+bool verify(const char *what, bool passed)
+{
+    printf("Verification of %s: %s\n", what, passed ? "passed" : "FAILED");
+    return passed;
+}
+
 /* Thread function for counting primes */
 void *
 prime_check(void *_args)
@@ -105,7 +122,7 @@ prime_check(void *_args)
     pthread_exit(NULL);
 }
 
-int multicore_processing_prime(int64_t digits, int num_threads)
+int64_t multicore_processing_prime(int64_t digits, int num_threads)
 {
     pthread_t threads[num_threads];
     struct range *args[num_threads];
@@ -119,17 +136,20 @@ int multicore_processing_prime(int64_t digits, int num_threads)
     int64_t start = 0;
     int64_t end = start + number_count;
     int64_t number_per_thread = number_count / num_threads;
+    int64_t remaining_numbers = number_count % num_threads;
 
-    /* Simplification: make range divide evenly among the threads */
-    // assert(number_count % num_threads == 0);
-
-    /* Assign a start/end value for each thread, then create it */
+    /* Assign a start/end value for each thread, then create it. The
+       first number_count % num_threads threads take one extra number. */
+    int64_t next_start = start;
     for (thread = 0; thread < num_threads; thread++)
     {
         args[thread] = calloc(sizeof(struct range), 1);
-        args[thread]->start = start + (thread * number_per_thread);
+        args[thread]->start = next_start;
         args[thread]->end =
             args[thread]->start + number_per_thread - 1;
+        if (thread < remaining_numbers)
+            args[thread]->end++;
+        next_start = args[thread]->end + 1;
         assert(pthread_create(&threads[thread], NULL, prime_check,
                               args[thread]) == 0);
     }
@@ -150,101 +170,431 @@ int multicore_processing_prime(int64_t digits, int num_threads)
     // printf("Total number of primes less than %ld: %ld\n", end,
     //        total_number);
 
-    return 0;
+    return total_number;
 }
 
-double calculate_execution_time_prime(int digits, int num_threads)
+double calculate_execution_time_prime(int digits, int num_threads, int64_t *total)
 {
 
     struct timeval start, end;
     gettimeofday(&start, NULL);
-    multicore_processing_prime(digits, num_threads);
+    int64_t result = multicore_processing_prime(digits, num_threads);
+    DO_NOT_OPTIMIZE(result);
     gettimeofday(&end, NULL);
+    *total = result;
     double time_taken = end.tv_sec + end.tv_usec / 1e6 -
                         start.tv_sec - start.tv_usec / 1e6; // in seconds
     return time_taken;
 }
 
+/* pi(5 * 10^7), the prime count the benchmark's default limit must give */
+#define PRIMES_BELOW_50M 3001134
+
+bool verify_prime_count(const char *what, int64_t digits, int64_t count)
+{
+    printf("%s prime count below %" PRId64 ": %" PRId64 "\n", what, digits, count);
+    if (digits != 50000000L)
+        return true;
+    return verify(what, count == PRIMES_BELOW_50M);
+}
+
 int calculate_score_prime(int digits, double execution_time)
 {
     int multi_core_score = (digits / execution_time) / 666;
     return round(multi_core_score);
 }
 
-double calculate_e_part(int64_t start, int64_t end)
+/* Floating-point mode of the e kernel. Its terms 1 / i! pass through the
+   subnormal range before they reach zero, and x86 cores without fast
+   subnormal hardware take a microcode assist on each such operation.
+   FTZ flushes subnormal results to zero and DAZ reads subnormal inputs
+   as zero, so timing both modes shows what the assists cost */
+enum e_fp_mode
+{
+    E_FP_IEEE,
+    E_FP_FTZ_DAZ,
+};
+
+const char *e_fp_mode_names[] = {"IEEE", "FTZ/DAZ"};
+
+/* MXCSR flush-to-zero and denormals-are-zero bits */
+#define MXCSR_FTZ 0x8000
+#define MXCSR_DAZ 0x0040
+
+/* Whether this build can switch modes; only x86 has MXCSR */
+bool e_fp_modes_available(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* MXCSR is per thread, so every worker sets its own */
+void set_fp_mode(enum e_fp_mode mode)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int csr = _mm_getcsr();
+    if (mode == E_FP_FTZ_DAZ)
+        csr |= MXCSR_FTZ | MXCSR_DAZ;
+    else
+        csr &= ~(MXCSR_FTZ | MXCSR_DAZ);
+    _mm_setcsr(csr);
+#else
+    (void)mode;
+#endif
+}
+
+/* Each e thread sums its own chunk [start, end] of the series and then
+   folds in the chunks of the threads after it. A chunk on its own is
+   sum = sum_i 1 / (start (start + 1) ... i) and product =
+   1 / (start (start + 1) ... end), so that its share of e is
+   sum / (start - 1)!, and the chunk after it is scaled by product */
+struct e_range
+{
+    int64_t start;
+    int64_t end;
+    double sum;
+    double product;
+    int64_t subnormals; /* terms that came out subnormal */
+    enum e_fp_mode mode;
+    int thread;
+    int num_threads;
+    pthread_t *threads;
+    struct e_range *ranges;
+};
+
+double calculate_e_part(int64_t start, int64_t end, double *product, int64_t *subnormals)
 {
     double result = 0.0;
     double term = 1.0;
+    int64_t subnormal = 0;
 
     for (int64_t i = start; i <= end; ++i)
     {
         term *= 1.0 / i;
         result += term;
+        subnormal += term != 0.0 && term < DBL_MIN;
     }
 
+    *product = term;
+    *subnormals = subnormal;
     return result;
 }
 
 // Thread function for calculating digits of e
 void *calculate_e_thread(void *_args)
 {
-    struct range *args = (struct range *)_args;
-    args->count = calculate_e_part(args->start, args->end);
+    struct e_range *args = (struct e_range *)_args;
+    set_fp_mode(args->mode);
+    args->sum = calculate_e_part(args->start, args->end, &args->product, &args->subnormals);
+
+    /* Combine as a tree: at each step thread t takes over the chunks
+       gathered by thread t + step, (sum, product) followed by
+       (sum', product') being (sum + product sum', product product') */
+    for (int step = 1; step < args->num_threads; step *= 2)
+    {
+        if (args->thread % (2 * step) != 0)
+            break;
+        if (args->thread + step >= args->num_threads)
+            continue;
+        struct e_range *next = &args->ranges[args->thread + step];
+        pthread_join(args->threads[args->thread + step], NULL);
+        args->sum += args->product * next->sum;
+        args->product *= next->product;
+        args->subnormals += next->subnormals;
+    }
 
     pthread_exit(NULL);
 }
 
 // Function to calculate digits of e using multiple threads
-double multicore_processing_e(int64_t iterations, int num_threads)
+double multicore_processing_e(int64_t iterations, int num_threads, enum e_fp_mode mode, int64_t *subnormals)
 {
     pthread_t threads[num_threads];
-    struct range *args[num_threads];
+    struct e_range ranges[num_threads];
     int thread;
 
     // Specify start and end values, then split based on the number of threads
     int64_t start = 1;
-    int64_t end = iterations;
     int64_t iterations_per_thread = iterations / num_threads;
+    int64_t remaining_iterations = iterations % num_threads;
 
-    // Assign start and end values for each thread, then create it
+    /* Assign start and end values for each thread. Threads only join
+       threads with a higher index, so creating them from the last one
+       down means every handle a thread waits on is already set */
     for (thread = 0; thread < num_threads; thread++)
     {
-        args[thread] = calloc(sizeof(struct range), 1);
-        args[thread]->start = start + (thread * iterations_per_thread);
-        args[thread]->end = args[thread]->start + iterations_per_thread - 1;
-        assert(pthread_create(&threads[thread], NULL, calculate_e_thread, args[thread]) == 0);
+        ranges[thread].start = start;
+        ranges[thread].end = start + iterations_per_thread - 1;
+        if (thread < remaining_iterations)
+            ranges[thread].end++;
+        start = ranges[thread].end + 1;
+        ranges[thread].mode = mode;
+        ranges[thread].thread = thread;
+        ranges[thread].num_threads = num_threads;
+        ranges[thread].threads = threads;
+        ranges[thread].ranges = ranges;
     }
+    for (thread = num_threads - 1; thread >= 0; thread--)
+        assert(pthread_create(&threads[thread], NULL, calculate_e_thread, &ranges[thread]) == 0);
 
-    // All threads are running. Join all to collect the results.
-    double total_result = 1.0; // Initial value for e
-    for (thread = 0; thread < num_threads; thread++)
+    // Thread 0 ends up holding the whole series from 1 / 1! on
+    pthread_join(threads[0], NULL);
+    *subnormals = ranges[0].subnormals;
+    return 1.0 + ranges[0].sum;
+}
+
+double calculate_execution_time_e(int64_t digits, int num_threads, enum e_fp_mode mode,
+                                  double *e, int64_t *subnormals)
+{
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    double result = multicore_processing_e(digits, num_threads, mode, subnormals);
+    DO_NOT_OPTIMIZE(result);
+    gettimeofday(&end, NULL);
+    *e = result;
+    double time_taken = end.tv_sec + end.tv_usec / 1e6 -
+                        start.tv_sec - start.tv_usec / 1e6; // in seconds
+    return time_taken;
+}
+
+/* The series is summed in doubles, so anything beyond a few ulps of
+   rounding means the kernel is broken */
+bool verify_e(const char *what, double e)
+{
+    printf("%s value of e: %.15f (error %.3g)\n", what, e, fabs(e - M_E));
+    return verify(what, fabs(e - M_E) <= 1e-12);
+}
+
+/* e = 1 + sum_k 1/k! by binary splitting. Over the terms k in (a, b]
+   the partial sum a! sum 1/k! is kept as an exact fraction P(a, b) /
+   Q(a, b) with Q(a, b) = (a + 1)(a + 2)...b, and two halves combine as
+   P(a, b) = P(a, m) Q(m, b) + P(m, b), Q(a, b) = Q(a, m) Q(m, b) */
+struct e_split
+{
+    int64_t a, b;
+    int depth;
+    struct bignum P, Q;
+};
+
+/* Subtrees and merge products above this depth of the split tree get
+   their own threads; depth d gives 2^d concurrent subtrees */
+int e_parallel_depth = 0;
+
+void e_split(struct e_split *s);
+
+void *e_split_thread(void *_args)
+{
+    e_split((struct e_split *)_args);
+    return NULL;
+}
+
+void e_split(struct e_split *s)
+{
+    if (s->b - s->a == 1)
     {
-        pthread_join(threads[thread], NULL);
-        total_result += args[thread]->count;
-        free(args[thread]);
+        bn_set_u64(&s->P, 1);
+        bn_set_u64(&s->Q, s->b);
+        return;
     }
+    int64_t m = s->a + (s->b - s->a) / 2;
+    struct e_split left = {.a = s->a, .b = m, .depth = s->depth + 1};
+    struct e_split right = {.a = m, .b = s->b, .depth = s->depth + 1};
+    bn_init(&left.P);
+    bn_init(&left.Q);
+    bn_init(&right.P);
+    bn_init(&right.Q);
+
+    if (s->depth < e_parallel_depth)
+    {
+        pthread_t thread;
+        assert(pthread_create(&thread, NULL, e_split_thread, &left) == 0);
+        e_split(&right);
+        pthread_join(thread, NULL);
+
+        /* Both products of a merge are the same size, so they run side
+           by side */
+        struct bn_mul_job job;
+        bn_mul_job_start(&job, &s->Q, &left.Q, &right.Q);
+        bn_mul(&s->P, &left.P, &right.Q);
+        bn_mul_job_wait(&job);
+    }
+    else
+    {
+        e_split(&left);
+        e_split(&right);
+        bn_mul(&s->P, &left.P, &right.Q);
+        bn_mul(&s->Q, &left.Q, &right.Q);
+    }
+    bn_add(&s->P, &s->P, &right.P);
 
-    return total_result;
+    bn_free(&left.P);
+    bn_free(&left.Q);
+    bn_free(&right.P);
+    bn_free(&right.Q);
+}
+
+/* Smallest N with N! > 10^(digits + 10): the tail after term N is below
+   2 / (N + 1)!, far under the last digit returned */
+int64_t e_terms(int64_t digits)
+{
+    int64_t low = 1, high = 2;
+    while (lgamma(high + 1.0) / M_LN10 < digits + 10)
+        high *= 2;
+    while (low < high)
+    {
+        int64_t mid = low + (high - low) / 2;
+        if (lgamma(mid + 1.0) / M_LN10 < digits + 10)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
 }
 
-double calculate_execution_time_e(int64_t digits, int num_threads)
+/* The first digits decimals of e, malloc'd. Two guard limbs absorb the
+   truncation of P and Q and the last-unit error of the division */
+char *binary_splitting_e(int64_t digits, int threads)
 {
+    e_parallel_depth = 0;
+    while ((1 << e_parallel_depth) < threads)
+        e_parallel_depth++;
+
+    struct e_split root = {.a = 0, .b = e_terms(digits), .depth = 0};
+    bn_init(&root.P);
+    bn_init(&root.Q);
+    e_split(&root);
+
+    /* e B^k = B^k + P B^k / Q; only the ratio P / Q matters, so both
+       lose the same number of low limbs first */
+    size_t k = (digits + BN_BASE_DIGITS - 1) / BN_BASE_DIGITS + 2;
+    if (root.Q.size > k + 3)
+    {
+        long drop = root.Q.size - (k + 3);
+        bn_shift_limbs(&root.P, &root.P, -drop);
+        bn_shift_limbs(&root.Q, &root.Q, -drop);
+    }
+    struct bignum x, one;
+    bn_init(&x);
+    bn_init(&one);
+    bn_shift_limbs(&x, &root.P, k);
+    bn_div(&x, &x, &root.Q);
+    bn_set_u64(&one, 1);
+    bn_shift_limbs(&one, &one, k);
+    bn_add(&x, &x, &one);
+
+    /* x is 2 followed by the decimals */
+    char *decimals = bn_to_decimal(&x);
+    memmove(decimals, decimals + 1, digits);
+    decimals[digits] = '\0';
+
+    bn_free(&x);
+    bn_free(&one);
+    bn_free(&root.P);
+    bn_free(&root.Q);
+    return decimals;
+}
 
+double calculate_execution_time_e_digits(int64_t digits, int num_threads, char **decimals)
+{
     struct timeval start, end;
     gettimeofday(&start, NULL);
-    multicore_processing_e(digits, num_threads);
+    char *result = binary_splitting_e(digits, num_threads);
+    DO_NOT_OPTIMIZE(result);
     gettimeofday(&end, NULL);
+    *decimals = result;
     double time_taken = end.tv_sec + end.tv_usec / 1e6 -
                         start.tv_sec - start.tv_usec / 1e6; // in seconds
     return time_taken;
 }
 
+/* FNV-1a hashes of the first decimals of e, from exp(1) in Python's
+   decimal module */
+const struct
+{
+    int64_t digits;
+    uint64_t hash;
+} e_digit_hashes[] = {
+    {1000, 0x9e90e7d4eb1e0fd6ULL},
+    {10000, 0x6d4fb36914e832d6ULL},
+    {100000, 0x11dda34406698e90ULL},
+    {1000000, 0xf9b3ab6ea27df665ULL},
+    {10000000, 0xaab1ed015dc9807cULL},
+};
+
+bool verify_e_digits(const char *what, const char *decimals, int64_t digits)
+{
+    printf("%s decimals of e %" PRId64 " to %" PRId64 ": %s\n", what,
+           digits > 20 ? digits - 19 : 1, digits, decimals + (digits > 20 ? digits - 20 : 0));
+    uint64_t hash = bn_digits_hash(decimals, digits);
+    for (size_t i = 0; i < sizeof(e_digit_hashes) / sizeof(e_digit_hashes[0]); i++)
+        if (e_digit_hashes[i].digits == digits)
+            return verify(what, hash == e_digit_hashes[i].hash);
+
+    /* No reference for this length: the leading decimals must still match */
+    const char *known = "71828182845904523536028747135266249775724709369995";
+    size_t n = digits < (int64_t)strlen(known) ? (size_t)digits : strlen(known);
+    printf("No reference hash for %" PRId64 " digits, checking the first %zu only\n", digits, n);
+    return verify(what, strncmp(decimals, known, n) == 0);
+}
+
+/* -d: digits of e with one thread and with all of them, instead of the
+   e and prime benchmark */
+bool report_e_digits(int64_t digits, int processes)
+{
+    char *single, *multi;
+    double execution_time_single_core = calculate_execution_time_e_digits(digits, 1, &single);
+    double execution_time_multi_core = calculate_execution_time_e_digits(digits, processes, &multi);
+    bool valid = verify_e_digits("single core", single, digits);
+    valid = verify_e_digits("multi core", multi, digits) && valid;
+    printf("Execution time for %" PRId64 " digits of e with single core is %f\n", digits, execution_time_single_core);
+    printf("Execution time for %" PRId64 " digits of e with %d cores is %f\n", digits, processes, execution_time_multi_core);
+    printf("Speedup for %" PRId64 " digits of e is %f\n", digits, execution_time_single_core / execution_time_multi_core);
+    free(single);
+    free(multi);
+    return valid;
+}
+
 int calculate_score_e(int64_t digits, double execution_time)
 {
     int multi_core_score = (digits / execution_time) / (666 * 377);
     return round(multi_core_score);
 }
 
+/* -f: the e kernel timed in both floating-point modes, with the number
+   of subnormal terms each one produced */
+bool report_fp_modes(int64_t digits, int processes)
+{
+    if (!e_fp_modes_available())
+    {
+        printf("FTZ/DAZ is only available on x86\n");
+        return false;
+    }
+    bool valid = true;
+    double execution_time_multi_core[2];
+    for (int mode = E_FP_IEEE; mode <= E_FP_FTZ_DAZ; mode++)
+    {
+        double e_single_core, e_multi_core;
+        int64_t subnormals_single_core, subnormals_multi_core;
+        double execution_time_single_core = calculate_execution_time_e(digits, 1, mode, &e_single_core,
+                                                                       &subnormals_single_core);
+        execution_time_multi_core[mode] = calculate_execution_time_e(digits, processes, mode, &e_multi_core,
+                                                                     &subnormals_multi_core);
+        valid = verify_e("single core", e_single_core) && valid;
+        valid = verify_e("multi core", e_multi_core) && valid;
+        printf("%-7s single core score %d (%" PRId64 " subnormal terms), multi core score %d (%" PRId64 " subnormal terms)\n",
+               e_fp_mode_names[mode],
+               calculate_score_e(digits, execution_time_single_core), subnormals_single_core,
+               calculate_score_e(digits, execution_time_multi_core[mode]), subnormals_multi_core);
+    }
+    printf("Subnormal penalty (IEEE time / FTZ/DAZ time, multi core): %f\n",
+           execution_time_multi_core[E_FP_IEEE] / execution_time_multi_core[E_FP_FTZ_DAZ]);
+    return valid;
+}
+
 size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
 {
     // Simply print the response to the console
@@ -253,10 +603,37 @@ size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
     return size * nmemb;
 }
 
+void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-d digits] [-f]\n", program);
+    fprintf(stderr, "  -d digits  compute this many decimals of e by binary splitting instead\n");
+    fprintf(stderr, "  -f         time the e kernel with and without FTZ/DAZ and count subnormal terms instead\n");
+    exit(EXIT_FAILURE);
+}
+
 int main(int argc, char **argv)
 {
     int64_t digits_e = 20000000000L;
     int64_t digits_prime = 50000000L;
+    int64_t e_digits = 0;
+    bool fp_modes = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:f")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            e_digits = strtoll(optarg, NULL, 10);
+            if (e_digits < 1)
+                usage(argv[0]);
+            break;
+        case 'f':
+            fp_modes = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
     srand(time(NULL));
     int processes;
     char cpu_model[256];
@@ -420,10 +797,28 @@ int main(int argc, char **argv)
 
 #endif
 
-    double execution_time_single_core_e = calculate_execution_time_e(digits_e, 1);
-    double execution_time_multi_core_e = calculate_execution_time_e(digits_e, processes);
-    double execution_time_single_core_prime = calculate_execution_time_prime(digits_prime, 1);
-    double execution_time_multi_core_prime = calculate_execution_time_prime(digits_prime, processes);
+    if (e_digits > 0)
+    {
+        printf("CPU Model%s\n", model_info);
+        return report_e_digits(e_digits, processes) ? 0 : EXIT_FAILURE;
+    }
+    if (fp_modes)
+    {
+        printf("CPU Model%s\n", model_info);
+        return report_fp_modes(digits_e, processes) ? 0 : EXIT_FAILURE;
+    }
+
+    double e_single_core, e_multi_core;
+    int64_t primes_single_core, primes_multi_core;
+    int64_t subnormals;
+    double execution_time_single_core_e = calculate_execution_time_e(digits_e, 1, E_FP_IEEE, &e_single_core, &subnormals);
+    double execution_time_multi_core_e = calculate_execution_time_e(digits_e, processes, E_FP_IEEE, &e_multi_core, &subnormals);
+    double execution_time_single_core_prime = calculate_execution_time_prime(digits_prime, 1, &primes_single_core);
+    double execution_time_multi_core_prime = calculate_execution_time_prime(digits_prime, processes, &primes_multi_core);
+    bool valid = verify_e("single core", e_single_core);
+    valid = verify_e("multi core", e_multi_core) && valid;
+    valid = verify_prime_count("single core", digits_prime, primes_single_core) && valid;
+    valid = verify_prime_count("multi core", digits_prime, primes_multi_core) && valid;
     int64_t score_single_core_e = calculate_score_e(digits_e, execution_time_single_core_e);
     int64_t score_multi_core_e = calculate_score_e(digits_e, execution_time_multi_core_e);
     int64_t score_single_core_prime = calculate_score_prime(digits_prime, execution_time_single_core_prime);
@@ -483,6 +878,12 @@ int main(int argc, char **argv)
     char jsonString[1024];
     primeBenchmarkToJson(prime_benchmark, jsonString);
 
+    if (!valid)
+    {
+        printf("Result verification failed, run marked invalid and not uploaded\n");
+        return EXIT_FAILURE;
+    }
+
     // Server information
     const char *host = "taipan-benchmarks.vercel.app";
     const char *path = "/api/cpu-benchmarks";
@@ -1,6 +1,8 @@
-
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
 #include <math.h>
 #include <omp.h>
 
@@ -18,7 +20,145 @@ double calculatePi(int n) {
     return pi;
 }
 
-int main() {
+/* BBP digit extraction: the hex digits of pi after position d are the
+   fraction of 4 S(1) - 2 S(4) - S(5) - S(6), where
+   S(j) = sum_k 16^(d - k) / (8k + j). For k <= d the integer part of
+   each term is dropped by taking 16^(d - k) mod (8k + j), so no term is
+   ever larger than one and nothing underflows the way pow(16, k) does.
+   Fractions are kept as 64-bit binary fractions whose sums wrap mod 1. */
+
+/* Hex digits trusted from one evaluation: each term is truncated by
+   under 2^-64 and the weights 4, 2, 1, 1 add up to 8 per k, so below
+   position 2^32 the error stays under 2^-29, past the 28th bit */
+#define BBP_DIGITS_PER_BLOCK 7
+
+/* a * b mod m for m < 2^50: the double quotient is off by at most one,
+   and the exact remainder comes back in wrapping 64-bit arithmetic */
+static inline uint64_t mulMod(uint64_t a, uint64_t b, uint64_t m, double inverse) {
+    uint64_t q = (int64_t)((double)(int64_t)a * (double)(int64_t)b * inverse);
+    int64_t r = (int64_t)(a * b - q * m);
+    if (r < 0)
+        r += m;
+    else if (r >= (int64_t)m)
+        r -= m;
+    return r;
+}
+
+/* 16^e mod m by square and multiply */
+static uint64_t powMod16(uint64_t e, uint64_t m) {
+    double inverse = 1.0 / m;
+    uint64_t result = 1 % m;
+    uint64_t base = 16 % m;
+    while (e > 0) {
+        if (e & 1)
+            result = mulMod(result, base, m, inverse);
+        base = mulMod(base, base, m, inverse);
+        e >>= 1;
+    }
+    return result;
+}
+
+/* Fraction of S(j) at position d as a 64-bit binary fraction */
+uint64_t bbpSeries(uint64_t d, int j) {
+    uint64_t sum = 0;
+    for (uint64_t k = 0; k <= d; k++) {
+        uint64_t m = 8 * k + j;
+        uint64_t r = powMod16(d - k, m);
+        /* r / m to 64 bits; long double carries a 64-bit mantissa */
+        sum += (uint64_t)((long double)r / m * 0x1p64L);
+    }
+    /* Tail terms 16^-(k - d) / (8k + j) until they drop below 2^-64 */
+    for (uint64_t k = d + 1; k <= d + 16; k++) {
+        uint64_t m = 8 * k + j;
+        sum += (uint64_t)(((unsigned __int128)1 << (64 - 4 * (k - d))) / m);
+    }
+    return sum;
+}
+
+/* Hex digits of pi from position d + 1 on (the first digit after the
+   point is position 1), most significant first */
+uint64_t bbpFraction(uint64_t d) {
+    return 4 * bbpSeries(d, 1) - 2 * bbpSeries(d, 4) - bbpSeries(d, 5) - bbpSeries(d, 6);
+}
+
+/* count hex digits of pi from position on. Every block of
+   BBP_DIGITS_PER_BLOCK digits is an independent evaluation, so blocks
+   are spread over the OpenMP threads with no shared state */
+void bbpHexDigits(uint64_t position, int count, char *digits) {
+    int blocks = (count + BBP_DIGITS_PER_BLOCK - 1) / BBP_DIGITS_PER_BLOCK;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int b = 0; b < blocks; b++) {
+        uint64_t fraction = bbpFraction(position - 1 + (uint64_t)b * BBP_DIGITS_PER_BLOCK);
+        for (int i = 0; i < BBP_DIGITS_PER_BLOCK && b * BBP_DIGITS_PER_BLOCK + i < count; i++)
+            digits[b * BBP_DIGITS_PER_BLOCK + i] = "0123456789ABCDEF"[(fraction >> (60 - 4 * i)) & 15];
+    }
+    digits[count] = '\0';
+}
+
+/* Published hex digits of pi from the given position on (Bailey,
+   Borwein and Plouffe) */
+const struct {
+    uint64_t position;
+    const char *digits;
+} knownHexDigits[] = {
+    {1, "243F6A8885A308D3"},
+    {1000000, "26C65E52CB4593"},
+    {10000000, "17AF5863EFED8D"},
+    {100000000, "ECB840E21926EC"},
+    {1000000000, "85895585A0428B"},
+};
+
+/* Check the digits that overlap a published run; 1 when they all match
+   or there is nothing to compare against */
+int verifyHexDigits(uint64_t position, const char *digits) {
+    int checked = 0;
+    for (size_t i = 0; i < sizeof(knownHexDigits) / sizeof(knownHexDigits[0]); i++) {
+        uint64_t start = knownHexDigits[i].position;
+        size_t known = strlen(knownHexDigits[i].digits);
+        for (size_t n = 0; digits[n] != '\0'; n++) {
+            uint64_t at = position + n;
+            if (at < start || at >= start + known)
+                continue;
+            checked++;
+            if (digits[n] != knownHexDigits[i].digits[at - start]) {
+                printf("Verification FAILED at position %" PRIu64 "\n", at);
+                return 0;
+            }
+        }
+    }
+    if (checked > 0)
+        printf("Verification passed on %d published digits\n", checked);
+    else
+        printf("No published digits at this position to verify against\n");
+    return 1;
+}
+
+/* ./main bbp position [count]: count hex digits of pi from position on */
+int bbpMain(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s bbp position [count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    uint64_t position = strtoull(argv[2], NULL, 10);
+    int count = argc > 3 ? atoi(argv[3]) : 14;
+    if (count < 1 || position < 1 || position > (1ULL << 32)) {
+        fprintf(stderr, "count must be positive and position between 1 and 2^32\n");
+        return EXIT_FAILURE;
+    }
+    char *digits = malloc(count + 1);
+    double start = omp_get_wtime();
+    bbpHexDigits(position, count, digits);
+    double time = omp_get_wtime() - start;
+    printf("Hex digits of pi from position %" PRIu64 ": %s\n", position, digits);
+    printf("Time with %d threads: %f s\n", omp_get_max_threads(), time);
+    int valid = verifyHexDigits(position, digits);
+    free(digits);
+    return valid ? 0 : EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "bbp") == 0)
+        return bbpMain(argc, argv);
     int n;
     printf("Enter the number of digits to calculate pi: ");
     scanf("%d", &n);
@@ -26,4 +166,3 @@ int main() {
     printf("Pi to %d digits: %.15f\n", n, pi);
     return 0;
 }
-
@@ -11,17 +11,24 @@
 #include <netdb.h>
 #include <inttypes.h>
 #include <string.h>
+#include <limits.h>
 #include <arpa/inet.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <pthread.h>
 #include <sys/wait.h> // for wait
 #include <unistd.h>   // for fork
-#define MAP_ANONYMOUS
+#include <sys/mman.h> // for the shared result page of forked workers
+#include "../bignum/bignum.h"
 #define MAX_BUFFER_SIZE 1024
 
 #define NUM_POINTS 10000000
 
+/* Optimization barrier: the compiler has to assume value is read and
+   changed here, so the work that produced it cannot be dropped or
+   folded away */
+#define DO_NOT_OPTIMIZE(value) __asm__ volatile("" : "+g"(value) : : "memory")
+
 struct prime_benchmark
 {
     /* data */
@@ -68,19 +75,106 @@ void primeBenchmarkToJson(struct prime_benchmark benchmark, char *jsonString)
             benchmark.time, benchmark.hostname, benchmark.key, benchmark.processes);
 }
 
-struct ThreadData
+/* xoshiro256** (Blackman and Vigna). Each worker owns one of these, so
+   drawing points needs no lock and no shared cache line, unlike rand() */
+struct xoshiro256
 {
-    int thread_id;
-    int points_in_circle;
+    uint64_t s[4];
 };
 
-double monte_carlo_pi(int points)
+/* Seed for the run; the same seed gives the same estimate */
+uint64_t pi_seed;
+
+uint64_t rotl64(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/* splitmix64, used only to spread the seed over the 256 bits of state */
+uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void xoshiro256_seed(struct xoshiro256 *rng, uint64_t seed)
+{
+    for (int i = 0; i < 4; i++)
+        rng->s[i] = splitmix64(&seed);
+}
+
+uint64_t xoshiro256_next(struct xoshiro256 *rng)
+{
+    uint64_t *s = rng->s;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+}
+
+/* Advance the generator by the polynomial in jump, see the two callers */
+void xoshiro256_jump_by(struct xoshiro256 *rng, const uint64_t jump[4])
+{
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        for (int b = 0; b < 64; b++)
+        {
+            if (jump[i] & (1ULL << b))
+            {
+                s0 ^= rng->s[0];
+                s1 ^= rng->s[1];
+                s2 ^= rng->s[2];
+                s3 ^= rng->s[3];
+            }
+            xoshiro256_next(rng);
+        }
+    }
+    rng->s[0] = s0;
+    rng->s[1] = s1;
+    rng->s[2] = s2;
+    rng->s[3] = s3;
+}
+
+/* Advance the generator by 2^128 draws. Worker i starts i jumps after the
+   seeded state, so the streams never overlap however many points a
+   worker takes */
+void xoshiro256_jump(struct xoshiro256 *rng)
+{
+    static const uint64_t jump[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+    xoshiro256_jump_by(rng, jump);
+}
+
+/* Advance the generator by 2^192 draws, used to split one worker's
+   stream into vector lanes that cannot reach the next worker's */
+void xoshiro256_long_jump(struct xoshiro256 *rng)
+{
+    static const uint64_t long_jump[] = {0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+                                         0x77710069854ee241ULL, 0x39109bb02acbe635ULL};
+    xoshiro256_jump_by(rng, long_jump);
+}
+
+/* Uniform double in [0, 1) from the top 53 bits */
+double xoshiro256_unit(struct xoshiro256 *rng)
+{
+    return (xoshiro256_next(rng) >> 11) * 0x1.0p-53;
+}
+
+int64_t monte_carlo_pi(struct xoshiro256 *rng, int64_t points)
 {
-    int inside_circle = 0;
-    for (int i = 0; i < points; i++)
+    int64_t inside_circle = 0;
+    for (int64_t i = 0; i < points; i++)
     {
-        double x = (double)rand() / RAND_MAX;
-        double y = (double)rand() / RAND_MAX;
+        double x = xoshiro256_unit(rng);
+        double y = xoshiro256_unit(rng);
         double distance = x * x + y * y;
         if (distance <= 1)
         {
@@ -90,58 +184,681 @@ double monte_carlo_pi(int points)
     return inside_circle;
 }
 
-double calculate_pi_with_multiprocessing(int digits, int processes)
+/* The batched kernels run PI_LANES generators side by side, stored as
+   structure of arrays so that word i of every lane loads as one vector */
+#define PI_LANES 8
+
+struct xoshiro256_lanes
 {
-    int points_per_process = digits / processes;
-    int points_left = digits % processes;
-    int points = points_per_process;
-    int points_in_circle = 0;
-    int status;
-    pid_t pid;
-    for (int i = 0; i < processes; i++)
+    uint64_t s[4][PI_LANES];
+} __attribute__((aligned(64)));
+
+/* Instruction set of the pi kernel, picked by CPUID in pi_kernel_init
+   unless capped with -i; scalar is monte_carlo_pi */
+const char *pi_isa = NULL;
+int64_t (*pi_batch_kernel)(struct xoshiro256_lanes *lanes, int64_t batches) = NULL;
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/* The vector kernels turn the top 52 bits of a draw into a double in
+   [1, 2) by setting the exponent of 1.0, then subtract 1. There is no
+   64-bit integer to double conversion before AVX-512DQ */
+#define PI_ONE_BITS 0x3ff0000000000000LL
+
+static inline __m128i rotl_sse2(__m128i x, int k)
+{
+    return _mm_or_si128(_mm_slli_epi64(x, k), _mm_srli_epi64(x, 64 - k));
+}
+
+/* xoshiro256** on two lanes; the multiplies by 5 and 9 are shift-adds
+   because SSE2 and AVX2 have no 64-bit multiply */
+static inline __m128i xoshiro256_next_sse2(__m128i s[4])
+{
+    __m128i times5 = _mm_add_epi64(_mm_slli_epi64(s[1], 2), s[1]);
+    __m128i rotated = rotl_sse2(times5, 7);
+    __m128i result = _mm_add_epi64(_mm_slli_epi64(rotated, 3), rotated);
+    __m128i t = _mm_slli_epi64(s[1], 17);
+    s[2] = _mm_xor_si128(s[2], s[0]);
+    s[3] = _mm_xor_si128(s[3], s[1]);
+    s[1] = _mm_xor_si128(s[1], s[2]);
+    s[0] = _mm_xor_si128(s[0], s[3]);
+    s[2] = _mm_xor_si128(s[2], t);
+    s[3] = rotl_sse2(s[3], 45);
+    return result;
+}
+
+static inline __m128d unit_sse2(__m128i bits)
+{
+    __m128i mantissa = _mm_or_si128(_mm_srli_epi64(bits, 12), _mm_set1_epi64x(PI_ONE_BITS));
+    return _mm_sub_pd(_mm_castsi128_pd(mantissa), _mm_set1_pd(1.0));
+}
+
+/* Each batch draws one point per lane. A compare sets a lane to all ones,
+   which is -1, when the point is inside the circle, so subtracting the
+   mask counts hits per lane without leaving the vector unit */
+int64_t pi_batches_sse2(struct xoshiro256_lanes *lanes, int64_t batches)
+{
+    __m128i s[PI_LANES / 2][4];
+    for (int v = 0; v < PI_LANES / 2; v++)
+        for (int i = 0; i < 4; i++)
+            s[v][i] = _mm_load_si128((__m128i *)&lanes->s[i][2 * v]);
+
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128i hits = _mm_setzero_si128();
+    for (int64_t b = 0; b < batches; b++)
+    {
+        for (int v = 0; v < PI_LANES / 2; v++)
+        {
+            __m128d x = unit_sse2(xoshiro256_next_sse2(s[v]));
+            __m128d y = unit_sse2(xoshiro256_next_sse2(s[v]));
+            __m128d distance = _mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y));
+            hits = _mm_sub_epi64(hits, _mm_castpd_si128(_mm_cmple_pd(distance, one)));
+        }
+    }
+    int64_t lane_hits[2];
+    _mm_storeu_si128((__m128i *)lane_hits, hits);
+    int64_t inside_circle = lane_hits[0] + lane_hits[1];
+
+    for (int v = 0; v < PI_LANES / 2; v++)
+        for (int i = 0; i < 4; i++)
+            _mm_store_si128((__m128i *)&lanes->s[i][2 * v], s[v][i]);
+    return inside_circle;
+}
+
+__attribute__((target("avx2"))) static inline __m256i rotl_avx2(__m256i x, int k)
+{
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+__attribute__((target("avx2"))) static inline __m256i xoshiro256_next_avx2(__m256i s[4])
+{
+    __m256i times5 = _mm256_add_epi64(_mm256_slli_epi64(s[1], 2), s[1]);
+    __m256i rotated = rotl_avx2(times5, 7);
+    __m256i result = _mm256_add_epi64(_mm256_slli_epi64(rotated, 3), rotated);
+    __m256i t = _mm256_slli_epi64(s[1], 17);
+    s[2] = _mm256_xor_si256(s[2], s[0]);
+    s[3] = _mm256_xor_si256(s[3], s[1]);
+    s[1] = _mm256_xor_si256(s[1], s[2]);
+    s[0] = _mm256_xor_si256(s[0], s[3]);
+    s[2] = _mm256_xor_si256(s[2], t);
+    s[3] = rotl_avx2(s[3], 45);
+    return result;
+}
+
+__attribute__((target("avx2"))) static inline __m256d unit_avx2(__m256i bits)
+{
+    __m256i mantissa = _mm256_or_si256(_mm256_srli_epi64(bits, 12), _mm256_set1_epi64x(PI_ONE_BITS));
+    return _mm256_sub_pd(_mm256_castsi256_pd(mantissa), _mm256_set1_pd(1.0));
+}
+
+__attribute__((target("avx2"))) int64_t pi_batches_avx2(struct xoshiro256_lanes *lanes, int64_t batches)
+{
+    __m256i s[PI_LANES / 4][4];
+    for (int v = 0; v < PI_LANES / 4; v++)
+        for (int i = 0; i < 4; i++)
+            s[v][i] = _mm256_load_si256((__m256i *)&lanes->s[i][4 * v]);
+
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256i hits = _mm256_setzero_si256();
+    for (int64_t b = 0; b < batches; b++)
     {
-        if (points_left > 0)
+        for (int v = 0; v < PI_LANES / 4; v++)
         {
-            points = points_per_process + 1;
-            points_left--;
+            __m256d x = unit_avx2(xoshiro256_next_avx2(s[v]));
+            __m256d y = unit_avx2(xoshiro256_next_avx2(s[v]));
+            __m256d distance = _mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y));
+            hits = _mm256_sub_epi64(hits, _mm256_castpd_si256(_mm256_cmp_pd(distance, one, _CMP_LE_OQ)));
         }
-        else
+    }
+    int64_t lane_hits[4];
+    _mm256_storeu_si256((__m256i *)lane_hits, hits);
+    int64_t inside_circle = lane_hits[0] + lane_hits[1] + lane_hits[2] + lane_hits[3];
+
+    for (int v = 0; v < PI_LANES / 4; v++)
+        for (int i = 0; i < 4; i++)
+            _mm256_store_si256((__m256i *)&lanes->s[i][4 * v], s[v][i]);
+    return inside_circle;
+}
+
+/* AVX-512 holds all eight lanes in one register, rotates natively and
+   compares straight into a mask register, counted with popcnt */
+__attribute__((target("avx512f,popcnt"))) int64_t pi_batches_avx512(struct xoshiro256_lanes *lanes, int64_t batches)
+{
+    __m512i s0 = _mm512_load_si512(lanes->s[0]);
+    __m512i s1 = _mm512_load_si512(lanes->s[1]);
+    __m512i s2 = _mm512_load_si512(lanes->s[2]);
+    __m512i s3 = _mm512_load_si512(lanes->s[3]);
+    const __m512i one_bits = _mm512_set1_epi64(PI_ONE_BITS);
+    const __m512d one = _mm512_set1_pd(1.0);
+    int64_t inside_circle = 0;
+    for (int64_t b = 0; b < batches; b++)
+    {
+        __m512d point[2];
+        for (int j = 0; j < 2; j++)
+        {
+            __m512i times5 = _mm512_add_epi64(_mm512_slli_epi64(s1, 2), s1);
+            __m512i rotated = _mm512_rol_epi64(times5, 7);
+            __m512i result = _mm512_add_epi64(_mm512_slli_epi64(rotated, 3), rotated);
+            __m512i t = _mm512_slli_epi64(s1, 17);
+            s2 = _mm512_xor_si512(s2, s0);
+            s3 = _mm512_xor_si512(s3, s1);
+            s1 = _mm512_xor_si512(s1, s2);
+            s0 = _mm512_xor_si512(s0, s3);
+            s2 = _mm512_xor_si512(s2, t);
+            s3 = _mm512_rol_epi64(s3, 45);
+            __m512i mantissa = _mm512_or_si512(_mm512_srli_epi64(result, 12), one_bits);
+            point[j] = _mm512_sub_pd(_mm512_castsi512_pd(mantissa), one);
+        }
+        __m512d distance = _mm512_add_pd(_mm512_mul_pd(point[0], point[0]),
+                                         _mm512_mul_pd(point[1], point[1]));
+        inside_circle += __builtin_popcount(_mm512_cmp_pd_mask(distance, one, _CMP_LE_OQ));
+    }
+    _mm512_store_si512(lanes->s[0], s0);
+    _mm512_store_si512(lanes->s[1], s1);
+    _mm512_store_si512(lanes->s[2], s2);
+    _mm512_store_si512(lanes->s[3], s3);
+    return inside_circle;
+}
+#endif
+
+/* Pick the widest batched kernel the CPU supports, at most the one asked
+   for with -i; scalar, or a CPU without SSE2, keeps monte_carlo_pi */
+void pi_kernel_init(void)
+{
+    const char *requested = pi_isa;
+    pi_isa = "scalar";
+    pi_batch_kernel = NULL;
+    if (requested != NULL && strcmp(requested, "scalar") == 0)
+        return;
+#if defined(__x86_64__) || defined(__i386__)
+    bool allow_avx512 = requested == NULL || strcmp(requested, "avx512") == 0;
+    bool allow_avx2 = allow_avx512 || strcmp(requested, "avx2") == 0;
+    if (allow_avx512 && __builtin_cpu_supports("avx512f"))
+    {
+        pi_isa = "avx512";
+        pi_batch_kernel = pi_batches_avx512;
+    }
+    else if (allow_avx2 && __builtin_cpu_supports("avx2"))
+    {
+        pi_isa = "avx2";
+        pi_batch_kernel = pi_batches_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        pi_isa = "sse2";
+        pi_batch_kernel = pi_batches_sse2;
+    }
+#endif
+}
+
+/* Lane l of a worker starts l + 1 long jumps after the worker's own
+   stream, which stays in the worker to draw the points that do not fill
+   a whole batch */
+int64_t monte_carlo_pi_batched(struct xoshiro256 *rng, int64_t points)
+{
+    if (pi_batch_kernel == NULL)
+        return monte_carlo_pi(rng, points);
+
+    struct xoshiro256_lanes lanes;
+    struct xoshiro256 lane = *rng;
+    for (int l = 0; l < PI_LANES; l++)
+    {
+        xoshiro256_long_jump(&lane);
+        for (int i = 0; i < 4; i++)
+            lanes.s[i][l] = lane.s[i];
+    }
+    return pi_batch_kernel(&lanes, points / PI_LANES) +
+           monte_carlo_pi(rng, points % PI_LANES);
+}
+
+/* Direction numbers of the first two Sobol dimensions as 64-bit binary
+   fractions: dimension 1 is van der Corput, v_k = 2^-k; dimension 2 uses
+   the primitive polynomial x + 1, v_k = v_(k-1) ^ (v_(k-1) >> 1) */
+#define SOBOL_BITS 64
+
+uint64_t sobol_directions[2][SOBOL_BITS];
+
+void sobol_init(void)
+{
+    for (int k = 0; k < SOBOL_BITS; k++)
+    {
+        sobol_directions[0][k] = 1ULL << (SOBOL_BITS - 1 - k);
+        sobol_directions[1][k] = k == 0 ? 1ULL << (SOBOL_BITS - 1)
+                                        : sobol_directions[1][k - 1] ^ (sobol_directions[1][k - 1] >> 1);
+    }
+}
+
+/* Count the points first, first + 1, ... of the 2D Sobol sequence that
+   fall inside the quarter circle. Point n is the XOR of the directions
+   for the set bits of gray(n), so a worker jumps straight to its slice;
+   after that gray-code order changes a single bit, the lowest zero bit
+   of n, per step, costing one ctz and one XOR per coordinate */
+int64_t sobol_pi(int64_t first, int64_t points)
+{
+    uint64_t x = 0, y = 0;
+    uint64_t gray = (uint64_t)first ^ ((uint64_t)first >> 1);
+    for (int k = 0; gray != 0; k++, gray >>= 1)
+    {
+        if (gray & 1)
         {
-            points = points_per_process;
+            x ^= sobol_directions[0][k];
+            y ^= sobol_directions[1][k];
         }
-        pid = fork();
+    }
+
+    int64_t inside_circle = 0;
+    for (uint64_t n = first; n < (uint64_t)(first + points); n++)
+    {
+        double px = (x >> 11) * 0x1.0p-53;
+        double py = (y >> 11) * 0x1.0p-53;
+        inside_circle += px * px + py * py <= 1;
+        int bit = __builtin_ctzll(~n);
+        x ^= sobol_directions[0][bit];
+        y ^= sobol_directions[1][bit];
+    }
+    return inside_circle;
+}
+
+/* Points come from the pseudo-random generators or, with -q, from the
+   Sobol sequence, which covers the square far more evenly: the error
+   falls close to 1 / points instead of 1 / sqrt(points) */
+bool quasi_monte_carlo = false;
+
+/* One worker's share of the run. Each sits on its own cache line so the
+   result writes of neighbouring workers do not false-share */
+struct ThreadData
+{
+    struct xoshiro256 rng;
+    int64_t first;
+    int64_t points;
+    int64_t points_in_circle;
+} __attribute__((aligned(64)));
+
+/* How the workers are started: pthreads writing their counts into padded
+   slots, or forked processes writing them into a MAP_SHARED page */
+enum pi_model
+{
+    PI_THREADS,
+    PI_FORK
+};
+
+const char *pi_model_names[] = {"threads", "fork"};
+enum pi_model pi_model = PI_THREADS;
+
+/* Split the points over the workers and give worker i the stream i jumps
+   after the seeded state */
+void pi_prepare_workers(struct ThreadData *workers, int64_t digits, int processes)
+{
+    struct xoshiro256 rng;
+    xoshiro256_seed(&rng, pi_seed);
+    int64_t first = 0;
+    for (int i = 0; i < processes; i++)
+    {
+        workers[i].rng = rng;
+        workers[i].first = first;
+        workers[i].points = digits / processes + (i < digits % processes);
+        workers[i].points_in_circle = 0;
+        first += workers[i].points;
+        xoshiro256_jump(&rng);
+    }
+}
+
+void pi_count_points(struct ThreadData *worker)
+{
+    if (quasi_monte_carlo)
+        worker->points_in_circle = sobol_pi(worker->first, worker->points);
+    else
+        worker->points_in_circle = monte_carlo_pi_batched(&worker->rng, worker->points);
+}
+
+void *pi_thread(void *_args)
+{
+    pi_count_points((struct ThreadData *)_args);
+    return NULL;
+}
+
+int64_t pi_run_threads(struct ThreadData *workers, int processes)
+{
+    pthread_t threads[processes];
+    for (int i = 0; i < processes; i++)
+        assert(pthread_create(&threads[i], NULL, pi_thread, &workers[i]) == 0);
+    int64_t points_in_circle = 0;
+    for (int i = 0; i < processes; i++)
+    {
+        pthread_join(threads[i], NULL);
+        points_in_circle += workers[i].points_in_circle;
+    }
+    return points_in_circle;
+}
+
+/* The workers array lives in a MAP_SHARED page, so the parent reads the
+   full 64-bit counts the children leave there; an exit status only
+   carries 8 bits */
+int64_t pi_run_fork(struct ThreadData *workers, int processes)
+{
+    for (int i = 0; i < processes; i++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+            error("fork");
         if (pid == 0)
         {
-            points_in_circle = monte_carlo_pi(points);
-            exit(points_in_circle);
+            pi_count_points(&workers[i]);
+            _exit(EXIT_SUCCESS);
         }
     }
+    int64_t points_in_circle = 0;
     for (int i = 0; i < processes; i++)
     {
-        wait(&status);
-        points_in_circle += WEXITSTATUS(status);
+        int status;
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            error("pi worker process failed");
     }
+    for (int i = 0; i < processes; i++)
+        points_in_circle += workers[i].points_in_circle;
+    return points_in_circle;
+}
+
+double calculate_pi_with_multiprocessing(int64_t digits, int processes, enum pi_model model)
+{
+    size_t bytes = processes * sizeof(struct ThreadData);
+    struct ThreadData *workers = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (workers == MAP_FAILED)
+        error("mmap");
+    pi_prepare_workers(workers, digits, processes);
+    int64_t points_in_circle = model == PI_FORK ? pi_run_fork(workers, processes)
+                                                : pi_run_threads(workers, processes);
+    munmap(workers, bytes);
     return 4 * (double)points_in_circle / digits;
 }
 
-double calculate_execution_time(int digits, int num_threads)
+double calculate_execution_time(int64_t digits, int num_threads, enum pi_model model, double *estimate)
 {
 
     struct timeval start, end;
     gettimeofday(&start, NULL);
-    calculate_pi_with_multiprocessing(digits, num_threads);
+    double result = calculate_pi_with_multiprocessing(digits, num_threads, model);
+    DO_NOT_OPTIMIZE(result);
     gettimeofday(&end, NULL);
+    *estimate = result;
     double time_taken = end.tv_sec + end.tv_usec / 1e6 -
                         start.tv_sec - start.tv_usec / 1e6; // in seconds
     return time_taken;
 }
 
+/* Print a verification line and return whether it passed */
+bool verify(const char *what, bool passed)
+{
+    printf("Verification of %s: %s\n", what, passed ? "passed" : "FAILED");
+    return passed;
+}
+
+/* A Monte Carlo estimate from points samples has standard deviation
+   4 * sqrt(p * (1 - p) / points) with p = pi / 4; anything further
+   than six of those from pi is not a working kernel */
+bool verify_pi_estimate(const char *what, double estimate, int64_t points)
+{
+    double p = M_PI / 4;
+    double sigma = 4 * sqrt(p * (1 - p) / points);
+    printf("%s estimate of pi: %.9f (error %.3g, tolerance %.3g)\n",
+           what, estimate, fabs(estimate - M_PI), 6 * sigma);
+    return verify(what, fabs(estimate - M_PI) <= 6 * sigma);
+}
+
+/* Time the multi core run under both execution models, plus a run with
+   one point per worker that is almost all startup and teardown cost */
+void report_execution_models(int64_t digits, int processes)
+{
+    for (int model = PI_THREADS; model <= PI_FORK; model++)
+    {
+        double estimate;
+        double startup = calculate_execution_time(processes, processes, model, &estimate);
+        double run = calculate_execution_time(digits, processes, model, &estimate);
+        printf("%-7s startup %.6f s, run %.6f s, estimate %.9f\n",
+               pi_model_names[model], startup, run, estimate);
+    }
+}
+
+/* Chudnovsky series, about 14.18 digits of pi per term:
+   1 / pi = 12 sum_k (-1)^k (6k)! (13591409 + 545140134 k)
+                        / ((3k)! (k!)^3 640320^(3k + 3/2))
+   Binary splitting keeps the partial sums over terms [a, b) as exact
+   integers P(a, b), Q(a, b), T(a, b), and at the end
+   pi = 426880 sqrt(10005) Q(0, N) / T(0, N) */
+#define CHUDNOVSKY_DIGITS_PER_TERM 14.181647462725477
+
+struct chudnovsky_split
+{
+    int64_t a, b;
+    int depth;
+    bool need_p; /* P of the rightmost subtrees is never used */
+    struct bignum P, Q, T;
+};
+
+/* Subtrees and merge products above this depth of the split tree get
+   their own threads; depth d gives 2^d concurrent subtrees */
+int chudnovsky_parallel_depth = 0;
+
+void chudnovsky_split(struct chudnovsky_split *s);
+
+void *chudnovsky_split_thread(void *_args)
+{
+    chudnovsky_split((struct chudnovsky_split *)_args);
+    return NULL;
+}
+
+/* Term a alone: P = -(6a - 5)(2a - 1)(6a - 1), Q = a^3 640320^3 / 24,
+   T = P (13591409 + 545140134 a); 640320^3 / 24 = 640320^2 * 26680 */
+void chudnovsky_leaf(struct chudnovsky_split *s)
+{
+    int64_t a = s->a;
+    if (a == 0)
+    {
+        bn_set_u64(&s->P, 1);
+        bn_set_u64(&s->Q, 1);
+    }
+    else
+    {
+        bn_set_u64(&s->P, (uint64_t)(6 * a - 5) * (2 * a - 1));
+        bn_mul_u32(&s->P, &s->P, 6 * a - 1);
+        s->P.sign = -1;
+        bn_set_u64(&s->Q, a);
+        bn_mul_u32(&s->Q, &s->Q, a);
+        bn_mul_u32(&s->Q, &s->Q, a);
+        bn_mul_u32(&s->Q, &s->Q, 640320);
+        bn_mul_u32(&s->Q, &s->Q, 640320);
+        bn_mul_u32(&s->Q, &s->Q, 26680);
+    }
+    struct bignum c;
+    bn_init(&c);
+    bn_set_u64(&c, 13591409 + 545140134ULL * a);
+    bn_mul(&s->T, &s->P, &c);
+    bn_free(&c);
+}
+
+/* [a, b) from [a, m) and [m, b): P = Pl Pr, Q = Ql Qr, T = Tl Qr + Pl Tr */
+void chudnovsky_split(struct chudnovsky_split *s)
+{
+    if (s->b - s->a == 1)
+    {
+        chudnovsky_leaf(s);
+        return;
+    }
+    int64_t m = s->a + (s->b - s->a) / 2;
+    struct chudnovsky_split left = {.a = s->a, .b = m, .depth = s->depth + 1, .need_p = true};
+    struct chudnovsky_split right = {.a = m, .b = s->b, .depth = s->depth + 1, .need_p = s->need_p};
+    bn_init(&left.P);
+    bn_init(&left.Q);
+    bn_init(&left.T);
+    bn_init(&right.P);
+    bn_init(&right.Q);
+    bn_init(&right.T);
+
+    bool parallel = s->depth < chudnovsky_parallel_depth;
+    if (parallel)
+    {
+        pthread_t thread;
+        assert(pthread_create(&thread, NULL, chudnovsky_split_thread, &left) == 0);
+        chudnovsky_split(&right);
+        pthread_join(thread, NULL);
+
+        /* The top merges are the biggest products and there are few of
+           them, so their independent multiplications run side by side */
+        struct bn_mul_job jobs[2];
+        bn_mul_job_start(&jobs[0], &s->T, &left.T, &right.Q);
+        bn_mul_job_start(&jobs[1], &s->Q, &left.Q, &right.Q);
+        if (s->need_p)
+            bn_mul(&s->P, &left.P, &right.P);
+        bn_mul(&right.T, &left.P, &right.T);
+        bn_mul_job_wait(&jobs[0]);
+        bn_mul_job_wait(&jobs[1]);
+    }
+    else
+    {
+        chudnovsky_split(&left);
+        chudnovsky_split(&right);
+        bn_mul(&s->T, &left.T, &right.Q);
+        bn_mul(&s->Q, &left.Q, &right.Q);
+        if (s->need_p)
+            bn_mul(&s->P, &left.P, &right.P);
+        bn_mul(&right.T, &left.P, &right.T);
+    }
+    bn_add(&s->T, &s->T, &right.T);
+
+    bn_free(&left.P);
+    bn_free(&left.Q);
+    bn_free(&left.T);
+    bn_free(&right.P);
+    bn_free(&right.Q);
+    bn_free(&right.T);
+}
+
+/* The first digits decimals of pi, malloc'd. The final division and
+   square root carry three guard limbs so that their last-unit errors,
+   scaled up by 426880 * 10005, stay clear of the digits returned */
+char *chudnovsky_pi(int64_t digits, int threads)
+{
+    chudnovsky_parallel_depth = 0;
+    while ((1 << chudnovsky_parallel_depth) < threads)
+        chudnovsky_parallel_depth++;
+
+    struct chudnovsky_split root = {.a = 0, .b = digits / CHUDNOVSKY_DIGITS_PER_TERM + 2, .depth = 0, .need_p = false};
+    bn_init(&root.P);
+    bn_init(&root.Q);
+    bn_init(&root.T);
+    chudnovsky_split(&root);
+
+    /* pi B^k = 426880 * 10005 * (B^k / sqrt(10005)) * Q / T. Q and T are
+       much longer than k limbs; only their ratio matters, so both lose
+       the same number of low limbs first */
+    size_t k = (digits + BN_BASE_DIGITS - 1) / BN_BASE_DIGITS + 3;
+    if (root.T.size > k + 3)
+    {
+        long drop = root.T.size - (k + 3);
+        bn_shift_limbs(&root.Q, &root.Q, -drop);
+        bn_shift_limbs(&root.T, &root.T, -drop);
+    }
+    struct bignum x;
+    bn_init(&x);
+    bn_inverse_sqrt_u32(&x, 10005, k);
+    bn_mul_u32(&x, &x, 10005);
+    bn_mul_u32(&x, &x, 426880);
+    bn_mul(&x, &x, &root.Q);
+    bn_div(&x, &x, &root.T);
+
+    /* x is 3 followed by the decimals */
+    char *decimals = bn_to_decimal(&x);
+    memmove(decimals, decimals + 1, digits);
+    decimals[digits] = '\0';
+
+    bn_free(&x);
+    bn_free(&root.P);
+    bn_free(&root.Q);
+    bn_free(&root.T);
+    return decimals;
+}
+
+double calculate_execution_time_digits(int64_t digits, int num_threads, char **decimals)
+{
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    char *result = chudnovsky_pi(digits, num_threads);
+    DO_NOT_OPTIMIZE(result);
+    gettimeofday(&end, NULL);
+    *decimals = result;
+    double time_taken = end.tv_sec + end.tv_usec / 1e6 -
+                        start.tv_sec - start.tv_usec / 1e6; // in seconds
+    return time_taken;
+}
+
+/* FNV-1a hashes of the first decimals of pi, from an independent
+   Chudnovsky run in Python's decimal module */
+const struct
+{
+    int64_t digits;
+    uint64_t hash;
+} pi_digit_hashes[] = {
+    {1000, 0x511d37c4f954c20fULL},
+    {10000, 0xec7b9ca0dd41a929ULL},
+    {100000, 0x787173ef15c2f208ULL},
+    {1000000, 0xce04279c6807286bULL},
+    {10000000, 0x7aa8fd23725da239ULL},
+};
+
+bool verify_pi_digits(const char *what, const char *decimals, int64_t digits)
+{
+    printf("%s decimals of pi %" PRId64 " to %" PRId64 ": %s\n", what,
+           digits > 20 ? digits - 19 : 1, digits, decimals + (digits > 20 ? digits - 20 : 0));
+    uint64_t hash = bn_digits_hash(decimals, digits);
+    for (size_t i = 0; i < sizeof(pi_digit_hashes) / sizeof(pi_digit_hashes[0]); i++)
+        if (pi_digit_hashes[i].digits == digits)
+            return verify(what, hash == pi_digit_hashes[i].hash);
+
+    /* No reference for this length: the leading decimals must still match */
+    const char *known = "14159265358979323846264338327950288419716939937510";
+    size_t n = digits < (int64_t)strlen(known) ? (size_t)digits : strlen(known);
+    printf("No reference hash for %" PRId64 " digits, checking the first %zu only\n", digits, n);
+    return verify(what, strncmp(decimals, known, n) == 0);
+}
+
+/* -d: digits of pi with one thread and with all of them, instead of the
+   Monte Carlo estimate */
+bool report_pi_digits(int64_t digits, int processes)
+{
+    char *single, *multi;
+    double execution_time_single_core = calculate_execution_time_digits(digits, 1, &single);
+    double execution_time_multi_core = calculate_execution_time_digits(digits, processes, &multi);
+    bool valid = verify_pi_digits("single core", single, digits);
+    valid = verify_pi_digits("multi core", multi, digits) && valid;
+    printf("Execution time for %" PRId64 " digits of pi with single core is %f\n", digits, execution_time_single_core);
+    printf("Execution time for %" PRId64 " digits of pi with %d cores is %f\n", digits, processes, execution_time_multi_core);
+    printf("Speedup for %" PRId64 " digits of pi is %f\n", digits, execution_time_single_core / execution_time_multi_core);
+    free(single);
+    free(multi);
+    return valid;
+}
+
 int calculate_score(int digits, double execution_time)
 {
     int multi_core_score = (digits / execution_time) / (666 * 37);
     return round(multi_core_score);
 }
 
+void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-n points] [-s seed] [-m model] [-t] [-i isa] [-q] [-d digits]\n", program);
+    fprintf(stderr, "  -n points  number of random points (default 2000000000)\n");
+    fprintf(stderr, "  -s seed    random seed, to reproduce a run (default: the current time)\n");
+    fprintf(stderr, "  -m model   start workers as threads or fork (default threads)\n");
+    fprintf(stderr, "  -t         also time both models and their startup cost\n");
+    fprintf(stderr, "  -i isa     cap the kernel at scalar, sse2, avx2 or avx512 (default: best available)\n");
+    fprintf(stderr, "  -q         quasi-Monte Carlo: take the points from the 2D Sobol sequence\n");
+    fprintf(stderr, "  -d digits  compute this many decimals of pi by Chudnovsky binary splitting instead\n");
+    exit(EXIT_FAILURE);
+}
+
 size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
 {
     // Simply print the response to the console
@@ -153,6 +870,51 @@ size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
 int main(int argc, char **argv)
 {
     int64_t digits = 2000000000;
+    pi_seed = time(NULL);
+    bool compare_models = false;
+    int64_t pi_digits = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:m:ti:qd:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            digits = strtoll(optarg, NULL, 10);
+            if (digits < 1 || digits > INT_MAX)
+                usage(argv[0]);
+            break;
+        case 's':
+            pi_seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'm':
+            if (strcmp(optarg, pi_model_names[PI_THREADS]) == 0)
+                pi_model = PI_THREADS;
+            else if (strcmp(optarg, pi_model_names[PI_FORK]) == 0)
+                pi_model = PI_FORK;
+            else
+                usage(argv[0]);
+            break;
+        case 't':
+            compare_models = true;
+            break;
+        case 'i':
+            if (strcmp(optarg, "scalar") != 0 && strcmp(optarg, "sse2") != 0 &&
+                strcmp(optarg, "avx2") != 0 && strcmp(optarg, "avx512") != 0)
+                usage(argv[0]);
+            pi_isa = optarg;
+            break;
+        case 'q':
+            quasi_monte_carlo = true;
+            break;
+        case 'd':
+            pi_digits = strtoll(optarg, NULL, 10);
+            if (pi_digits < 1)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
     srand(time(NULL));
     int processes;
     char cpu_model[256];
@@ -316,8 +1078,25 @@ int main(int argc, char **argv)
 
 #endif
 
-    double execution_time_single_core = calculate_execution_time(digits, 1);
-    double execution_time_multi_core = calculate_execution_time(digits, processes);
+    if (pi_digits > 0)
+    {
+        printf("CPU Model%s\n", model_info);
+        return report_pi_digits(pi_digits, processes) ? 0 : EXIT_FAILURE;
+    }
+
+    pi_kernel_init();
+    sobol_init();
+    if (quasi_monte_carlo)
+        printf("Sobol sequence\n");
+    else
+        printf("Random seed: %" PRIu64 ", instruction set: %s\n", pi_seed, pi_isa);
+    double estimate_single_core, estimate_multi_core;
+    double execution_time_single_core = calculate_execution_time(digits, 1, pi_model, &estimate_single_core);
+    double execution_time_multi_core = calculate_execution_time(digits, processes, pi_model, &estimate_multi_core);
+    bool valid = verify_pi_estimate("single core", estimate_single_core, digits);
+    valid = verify_pi_estimate("multi core", estimate_multi_core, digits) && valid;
+    if (compare_models)
+        report_execution_models(digits, processes);
     printf("CPU Model%s", model_info);
     printf("\n");
     printf(os_display);
@@ -369,6 +1148,12 @@ int main(int argc, char **argv)
     char jsonString[1024];
     primeBenchmarkToJson(prime_benchmark, jsonString);
 
+    if (!valid)
+    {
+        printf("Result verification failed, run marked invalid and not uploaded\n");
+        return EXIT_FAILURE;
+    }
+
     // // Server information
     // const char *host = "taipan-benchmarks.vercel.app";
     // const char *path = "/api/cpu-benchmarks";
@@ -16,6 +16,11 @@
 #include <openssl/err.h>
 #define MAX_BUFFER_SIZE 1024
 
+/* Optimization barrier: the compiler has to assume value is read and
+   changed here, so the work that produced it cannot be dropped or
+   folded away */
+#define DO_NOT_OPTIMIZE(value) __asm__ volatile("" : "+g"(value) : : "memory")
+
 struct point_benchmark
 {
     /* data */
@@ -61,6 +66,13 @@ void pointBenchmarkToJson(struct point_benchmark benchmark, char *jsonString)
             benchmark.speedup, benchmark.efficiency, benchmark.cpu_utilization,
             benchmark.time, benchmark.hostname, benchmark.key, benchmark.processes);
 }
+/* Print a verification line and return whether it passed */
+bool verify(const char *what, bool passed)
+{
+    printf("Verification of %s: %s\n", what, passed ? "passed" : "FAILED");
+    return passed;
+}
+
 int64_t increment(int64_t x)
 {
     return x + 1;
@@ -73,6 +85,8 @@ int64_t add_to_number(int64_t n)
     for (i = 0; i < n; i++)
     {
         sum = increment(sum);
+        /* Without this the loop folds into return n */
+        DO_NOT_OPTIMIZE(sum);
     }
     return sum;
 }
@@ -103,18 +117,27 @@ int64_t add_to_number_parallel(int64_t n, int num_threads)
     return sum;
 }
 
-double calculate_execution_time(int64_t digits, int num_threads)
+double calculate_execution_time(int64_t digits, int num_threads, int64_t *sum)
 {
 
     struct timeval start, end;
     gettimeofday(&start, NULL);
-    add_to_number_parallel(digits, num_threads);
+    int64_t result = add_to_number_parallel(digits, num_threads);
+    DO_NOT_OPTIMIZE(result);
     gettimeofday(&end, NULL);
+    *sum = result;
     double time_taken = end.tv_sec + end.tv_usec / 1e6 -
                         start.tv_sec - start.tv_usec / 1e6; // in seconds
     return time_taken;
 }
 
+/* Every thread adds one n / num_threads times */
+bool verify_point_sum(const char *what, int64_t digits, int num_threads, int64_t sum)
+{
+    printf("%s sum: %" PRId64 "\n", what, sum);
+    return verify(what, sum == digits / num_threads * num_threads);
+}
+
 int64_t calculate_score(int64_t digits, double execution_time)
 {
     int64_t multi_core_score = (digits / execution_time) / 666666 * 1.213;
@@ -295,8 +318,11 @@ int main(int argc, char **argv)
 
 #endif
 
-    double execution_time_single_core = calculate_execution_time(digits, 1);
-    double execution_time_multi_core = calculate_execution_time(digits, processes);
+    int64_t sum_single_core, sum_multi_core;
+    double execution_time_single_core = calculate_execution_time(digits, 1, &sum_single_core);
+    double execution_time_multi_core = calculate_execution_time(digits, processes, &sum_multi_core);
+    bool valid = verify_point_sum("single core", digits, 1, sum_single_core);
+    valid = verify_point_sum("multi core", digits, processes, sum_multi_core) && valid;
     printf("CPU Model%s", model_info);
     printf("\n");
     printf(os_display);
@@ -348,6 +374,12 @@ int main(int argc, char **argv)
     char jsonString[1024];
     pointBenchmarkToJson(prime_benchmark, jsonString);
 
+    if (!valid)
+    {
+        printf("Result verification failed, run marked invalid and not uploaded\n");
+        return EXIT_FAILURE;
+    }
+
     // Server information
     const char *host = "taipan-benchmarks.vercel.app";
     const char *path = "/api/cpu-benchmarks";
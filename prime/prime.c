@@ -14,8 +14,25 @@
 #include <arpa/inet.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <stdatomic.h>
+#include <sched.h>
 #define MAX_BUFFER_SIZE 1024
 
+/* Optimization barrier: the compiler has to assume value is read and
+   changed here, so the work that produced it cannot be dropped or
+   folded away */
+#define DO_NOT_OPTIMIZE(value) __asm__ volatile("" : "+g"(value) : : "memory")
+
+/* Shared work queue for dynamic scheduling: threads claim the next
+   chunk of the range by bumping an atomic offset from start */
+struct prime_cursor
+{
+    atomic_int_fast64_t next;
+    int64_t start;
+    int64_t end;
+    int64_t chunk;
+};
+
 /* Each thread gets a start and end number and returns the number
    Of primes in that range */
 struct range
@@ -23,6 +40,11 @@ struct range
     int64_t start;
     int64_t end;
     int64_t count;
+    double busy;      /* seconds spent counting */
+    double predicted; /* estimated work from prime_cost */
+    struct prime_cursor *cursor;
+    int thread;       /* index and thread count for the cyclic schedule */
+    int num_threads;
 };
 
 struct prime_benchmark
@@ -71,41 +93,1092 @@ void primeBenchmarkToJson(struct prime_benchmark benchmark, char *jsonString)
             benchmark.time, benchmark.hostname, benchmark.key, benchmark.processes);
 }
 
+/* Count the primes in [start, end] by trial division, with the values
+   and divisors held in type, so value % iter is a divide of that width.
+   square_type must hold iter * iter without overflow. */
+#define DEFINE_TRIAL_KERNEL(name, type, square_type)                   \
+    int64_t name(int64_t start, int64_t end)                           \
+    {                                                                  \
+        type iter = 2;                                                 \
+        type value;                                                    \
+        int64_t count = 0;                                             \
+                                                                       \
+        /* Skip over any numbers < 2, which is the smallest prime */   \
+        if (start < 2)                                                 \
+            start = 2;                                                 \
+        /* An empty range, where end may be negative, must not reach  \
+           the cast of end to type */                                  \
+        if (end < start)                                               \
+            return 0;                                                  \
+                                                                       \
+        /* Loop from this thread's start to this thread's end */       \
+        for (value = start; value <= (type)end; value++)               \
+        {                                                              \
+            /* Trivial and intentionally slow algorithm:               \
+               Start with iter = 2; see if iter divides the number     \
+               evenly. If it does, it's not prime.                     \
+               Stop when iter exceeds the square root of value */      \
+            bool is_prime = true;                                      \
+            for (iter = 2; (square_type)iter * iter <= value && is_prime; iter++) \
+                if (value % iter == 0)                                 \
+                    is_prime = false;                                  \
+                                                                       \
+            if (is_prime)                                              \
+                count++;                                               \
+        }                                                              \
+                                                                       \
+        return count;                                                  \
+    }
+
+DEFINE_TRIAL_KERNEL(count_primes_trial, int64_t, int64_t)
+DEFINE_TRIAL_KERNEL(count_primes_trial32, uint32_t, uint64_t)
+
+/* Trial division at the narrowest width that holds the range: 32-bit
+   divides when end < 2^32, 64-bit otherwise */
+int64_t count_primes_trial_width(int64_t start, int64_t end)
+{
+    if (end < UINT32_MAX)
+        return count_primes_trial32(start, end);
+    return count_primes_trial(start, end);
+}
+
+/* Sieving primes up to sqrt(end), shared read-only by every sieve thread */
+uint32_t *base_primes = NULL;
+int64_t base_prime_count = 0;
+int64_t base_prime_limit = 0;
+
+/* Segment size in bytes; one byte per odd number. The default fits in
+   the L2 cache of everything we run on, -k lowers it to L1 size */
+int64_t sieve_segment_bytes = 256 * 1024;
+
+/* floor(sqrt(n)). The double estimate can be off by one either way, and
+   the corrections compare by division, since squaring root + 1 overflows
+   int64 when n is near INT64_MAX */
+int64_t isqrt64(int64_t n)
+{
+    if (n < 1)
+        return 0;
+    int64_t root = (int64_t)sqrt((double)n);
+    while (root > n / root)
+        root--;
+    while (root + 1 <= n / (root + 1))
+        root++;
+    return root;
+}
+
+/* Build the table of odd primes <= sqrt(end) with a plain sieve. Must
+   run before any thread calls count_primes_sieve. */
+void sieve_init(int64_t end)
+{
+    int64_t limit = isqrt64(end);
+    if (base_primes != NULL && limit <= base_prime_limit)
+        return;
+
+    uint8_t *composite = calloc(limit + 1, 1);
+    free(base_primes);
+    base_primes = malloc((limit / 2 + 1) * sizeof(uint32_t));
+    base_prime_count = 0;
+    for (int64_t p = 3; p <= limit; p += 2)
+    {
+        if (composite[p])
+            continue;
+        base_primes[base_prime_count++] = p;
+        for (int64_t m = p * p; m <= limit; m += 2 * p)
+            composite[m] = 1;
+    }
+    base_prime_limit = limit;
+    free(composite);
+}
+
+/* Segment and next[] of one thread's sieve, kept across calls so the
+   dynamic and cyclic schedules do not allocate and fault in fresh pages
+   for every chunk. They grow when a call needs more and are freed when
+   the thread exits */
+struct sieve_buffers
+{
+    uint8_t *sieve;
+    int64_t sieve_bytes;
+    int64_t *next;
+    int64_t next_count;
+};
+
+pthread_key_t sieve_buffers_key;
+pthread_once_t sieve_buffers_once = PTHREAD_ONCE_INIT;
+
+void sieve_buffers_free(void *_buffers)
+{
+    struct sieve_buffers *buffers = (struct sieve_buffers *)_buffers;
+    free(buffers->sieve);
+    free(buffers->next);
+    free(buffers);
+}
+
+void sieve_buffers_key_init(void)
+{
+    assert(pthread_key_create(&sieve_buffers_key, sieve_buffers_free) == 0);
+}
+
+/* The calling thread's buffers, with room for segment bytes and
+   next_count offsets */
+struct sieve_buffers *sieve_buffers_get(int64_t segment, int64_t next_count)
+{
+    pthread_once(&sieve_buffers_once, sieve_buffers_key_init);
+    struct sieve_buffers *buffers = pthread_getspecific(sieve_buffers_key);
+    if (buffers == NULL)
+    {
+        buffers = calloc(1, sizeof(struct sieve_buffers));
+        pthread_setspecific(sieve_buffers_key, buffers);
+    }
+    if (buffers->sieve_bytes < segment)
+    {
+        free(buffers->sieve);
+        buffers->sieve = malloc(segment);
+        buffers->sieve_bytes = segment;
+    }
+    if (buffers->next_count < next_count)
+    {
+        free(buffers->next);
+        buffers->next = malloc(next_count * sizeof(int64_t));
+        buffers->next_count = next_count;
+    }
+    return buffers;
+}
+
+/* Count the primes in [start, end] with a segmented Sieve of
+   Eratosthenes. Only odd numbers are stored, so one segment of
+   sieve_segment_bytes covers twice as many integers. */
+int64_t count_primes_sieve(int64_t start, int64_t end)
+{
+    int64_t count = 0;
+
+    if (start < 2)
+        start = 2;
+    if (end < start)
+        return 0;
+    if (start == 2)
+    {
+        count++;
+        start = 3;
+    }
+
+    /* First odd number in the range */
+    int64_t low = start | 1;
+    if (low > end)
+        return count;
+
+    int64_t segment = sieve_segment_bytes;
+    struct sieve_buffers *buffers = sieve_buffers_get(segment, base_prime_count + 1);
+    uint8_t *sieve = buffers->sieve;
+
+    /* Offset of the next odd multiple of each base prime, relative to the
+       start of the current segment. Carrying it across segments avoids a
+       division per prime per segment. */
+    int64_t *next = buffers->next;
+    int64_t primes_used = 0;
+    while (primes_used < base_prime_count &&
+           (int64_t)base_primes[primes_used] * base_primes[primes_used] <= end)
+    {
+        int64_t p = base_primes[primes_used];
+        int64_t offset;
+        if (p * p >= low)
+            offset = p * p - low;
+        else
+        {
+            /* Distance from low to the next multiple of p, then on to the
+               next odd one. Rounding low + p - 1 down would overflow for
+               ranges that end near INT64_MAX */
+            offset = (p - low % p) % p;
+            if (offset % 2 == 1)
+                offset += p;
+        }
+        next[primes_used] = offset / 2;
+        primes_used++;
+    }
+
+    /* Segments are stepped by odd-number index rather than by value, which
+       could step past INT64_MAX after the last one */
+    int64_t odd_count = (end - low) / 2 + 1;
+    for (int64_t seg_start = 0; seg_start < odd_count; seg_start += segment)
+    {
+        int64_t size = odd_count - seg_start;
+        if (size > segment)
+            size = segment;
+
+        memset(sieve, 1, size);
+        for (int64_t i = 0; i < primes_used; i++)
+        {
+            int64_t p = base_primes[i];
+            int64_t j = next[i];
+            for (; j < size; j += p)
+                sieve[j] = 0;
+            next[i] = j - segment;
+        }
+
+        for (int64_t j = 0; j < size; j++)
+            count += sieve[j];
+    }
+
+    return count;
+}
+
+/* Divisibility by an odd d without a divide (Granlund and Montgomery):
+   multiplying by d^-1 mod 2^64 maps the multiples of d exactly onto
+   [0, UINT64_MAX / d], so d | n iff n * inverse <= limit */
+struct divisibility
+{
+    uint64_t inverse;
+    uint64_t limit;
+    uint64_t square; /* d * d, to stop at sqrt(n) */
+};
+
+struct divisibility *divisibility_table = NULL;
+int64_t divisibility_count = 0;
+
+/* Build the inverse table from the sieve's odd base primes */
+void fastmod_init(int64_t end)
+{
+    sieve_init(end);
+    free(divisibility_table);
+    divisibility_table = malloc((base_prime_count + 1) * sizeof(struct divisibility));
+    divisibility_count = base_prime_count;
+    for (int64_t i = 0; i < base_prime_count; i++)
+    {
+        uint64_t d = base_primes[i];
+        uint64_t inverse = d;
+        for (int j = 0; j < 5; j++)
+            inverse *= 2 - d * inverse;
+        divisibility_table[i].inverse = inverse;
+        divisibility_table[i].limit = UINT64_MAX / d;
+        divisibility_table[i].square = d * d;
+    }
+}
+
+/* Count the primes in [start, end] by trial division over the odd
+   primes up to sqrt(end), testing divisibility with multiplications */
+int64_t count_primes_fastmod(int64_t start, int64_t end)
+{
+    int64_t count = 0;
+
+    if (start < 2)
+        start = 2;
+    if (end < start)
+        return 0;
+    if (start == 2)
+    {
+        count++;
+        start = 3;
+    }
+    for (uint64_t value = start | 1; value <= (uint64_t)end; value += 2)
+    {
+        bool is_prime = true;
+        for (int64_t i = 0; i < divisibility_count && divisibility_table[i].square <= value; i++)
+        {
+            if (value * divisibility_table[i].inverse <= divisibility_table[i].limit)
+            {
+                is_prime = false;
+                break;
+            }
+        }
+        if (is_prime)
+            count++;
+    }
+
+    return count;
+}
+
+/* Vectorized trial division: each SIMD lane holds a different prime
+   divisor as a double and every lane tests the same odd candidate c.
+   With q = floor(c * (1 / p)) the remainder r = c - q * p is exact
+   under FMA, and q is off by at most one for c < 2^52, so p divides c
+   iff |r| is 0 or p. Lanes past sqrt(c) are masked off by p * p <= c.
+
+   Putting candidates in the lanes instead was slower than the scalar
+   fastmod kernel: a batch has to run until its slowest lane, and most
+   batches hold a prime that needs the full scan to sqrt(c). */
+#define SIMD_EXACT_LIMIT (1LL << 52)
+
+/* Prime tables for the vector kernels, padded to a multiple of
+   SIMD_PAD lanes with entries that never match */
+#define SIMD_PAD 8
+double *simd_primes = NULL;
+double *simd_inverses = NULL;
+double *simd_squares = NULL;
+int64_t simd_prime_count = 0;
+
+/* Instruction set used by the simd engine, picked by CPUID in simd_init
+   unless capped with -i */
+const char *simd_isa = NULL;
+int64_t (*simd_kernel)(int64_t start, int64_t end) = NULL;
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/* Odd candidates start, start + 2, ... up to end, four divisors at once */
+__attribute__((target("avx2,fma"))) int64_t count_primes_avx2(int64_t start, int64_t end)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    int64_t count = 0;
+
+    for (int64_t value = start; value <= end; value += 2)
+    {
+        double candidate = (double)value;
+        __m256d c = _mm256_set1_pd(candidate);
+        bool is_prime = true;
+
+        for (int64_t i = 0; i < simd_prime_count && simd_squares[i] <= candidate; i += 4)
+        {
+            __m256d p = _mm256_loadu_pd(&simd_primes[i]);
+            __m256d q = _mm256_floor_pd(_mm256_mul_pd(c, _mm256_loadu_pd(&simd_inverses[i])));
+            __m256d r = _mm256_andnot_pd(sign, _mm256_fnmadd_pd(q, p, c));
+            __m256d divides = _mm256_or_pd(_mm256_cmp_pd(r, zero, _CMP_EQ_OQ),
+                                           _mm256_cmp_pd(r, p, _CMP_EQ_OQ));
+            divides = _mm256_and_pd(divides, _mm256_cmp_pd(_mm256_loadu_pd(&simd_squares[i]), c, _CMP_LE_OQ));
+            if (_mm256_movemask_pd(divides))
+            {
+                is_prime = false;
+                break;
+            }
+        }
+        if (is_prime)
+            count++;
+    }
+
+    return count;
+}
+
+/* Same as count_primes_avx2 with eight divisors at once */
+__attribute__((target("avx512f"))) int64_t count_primes_avx512(int64_t start, int64_t end)
+{
+    const __m512d zero = _mm512_setzero_pd();
+    int64_t count = 0;
+
+    for (int64_t value = start; value <= end; value += 2)
+    {
+        double candidate = (double)value;
+        __m512d c = _mm512_set1_pd(candidate);
+        bool is_prime = true;
+
+        for (int64_t i = 0; i < simd_prime_count && simd_squares[i] <= candidate; i += 8)
+        {
+            __m512d p = _mm512_loadu_pd(&simd_primes[i]);
+            __m512d q = _mm512_roundscale_pd(_mm512_mul_pd(c, _mm512_loadu_pd(&simd_inverses[i])),
+                                             _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+            __m512d r = _mm512_abs_pd(_mm512_fnmadd_pd(q, p, c));
+            __mmask8 divides = _mm512_cmp_pd_mask(r, zero, _CMP_EQ_OQ) |
+                               _mm512_cmp_pd_mask(r, p, _CMP_EQ_OQ);
+            divides &= _mm512_cmp_pd_mask(_mm512_loadu_pd(&simd_squares[i]), c, _CMP_LE_OQ);
+            if (divides)
+            {
+                is_prime = false;
+                break;
+            }
+        }
+        if (is_prime)
+            count++;
+    }
+
+    return count;
+}
+#endif
+
+/* Scalar fallback with the same divisors */
+int64_t count_primes_simd_scalar(int64_t start, int64_t end)
+{
+    return count_primes_fastmod(start, end);
+}
+
+/* Build the prime tables and pick the widest kernel the CPU supports */
+void simd_init(int64_t end)
+{
+    fastmod_init(end);
+    free(simd_primes);
+    free(simd_inverses);
+    free(simd_squares);
+    simd_primes = malloc((base_prime_count + SIMD_PAD) * sizeof(double));
+    simd_inverses = malloc((base_prime_count + SIMD_PAD) * sizeof(double));
+    simd_squares = malloc((base_prime_count + SIMD_PAD) * sizeof(double));
+    simd_prime_count = base_prime_count;
+    for (int64_t i = 0; i < base_prime_count + SIMD_PAD; i++)
+    {
+        if (i < base_prime_count)
+        {
+            simd_primes[i] = base_primes[i];
+            simd_inverses[i] = 1.0 / base_primes[i];
+            simd_squares[i] = (double)base_primes[i] * base_primes[i];
+        }
+        else
+        {
+            simd_primes[i] = 1;
+            simd_inverses[i] = 1;
+            simd_squares[i] = INFINITY;
+        }
+    }
+
+    const char *requested = simd_isa;
+    simd_isa = "scalar";
+    simd_kernel = count_primes_simd_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    bool allow_avx512 = requested == NULL || strcmp(requested, "avx512") == 0;
+    bool allow_avx2 = allow_avx512 || strcmp(requested, "avx2") == 0;
+    if (allow_avx512 && __builtin_cpu_supports("avx512f"))
+    {
+        simd_isa = "avx512";
+        simd_kernel = count_primes_avx512;
+    }
+    else if (allow_avx2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        simd_isa = "avx2";
+        simd_kernel = count_primes_avx2;
+    }
+#endif
+}
+
+/* Count the primes in [start, end] with the vector kernel picked by
+   simd_init; numbers past 2^52 are not exact as doubles and use the
+   scalar kernel */
+int64_t count_primes_simd(int64_t start, int64_t end)
+{
+    int64_t count = 0;
+
+    if (start < 2)
+        start = 2;
+    if (start == 2 && end >= 2)
+    {
+        count++;
+        start = 3;
+    }
+    start |= 1;
+    if (end >= SIMD_EXACT_LIMIT)
+    {
+        int64_t scalar_start = start > SIMD_EXACT_LIMIT ? start : SIMD_EXACT_LIMIT;
+        count += count_primes_simd_scalar(scalar_start, end);
+        end = SIMD_EXACT_LIMIT - 1;
+    }
+    if (start <= end)
+        count += simd_kernel(start, end);
+
+    return count;
+}
+
+/* Wheel factorization: only numbers coprime to the wheel modulus can be
+   prime (apart from the wheel's own primes), so both the candidates and
+   the trial divisors step through the residues coprime to the modulus.
+   The gap from each residue to the next is stored alongside it. */
+struct wheel
+{
+    int64_t modulus;
+    int size;
+    const int64_t *primes; /* primes dividing the modulus */
+    int prime_count;
+    const uint8_t *residues;
+    const uint8_t *gaps;
+};
+
+static const int64_t wheel30_primes[] = {2, 3, 5};
+static const uint8_t wheel30_residues[] = {1, 7, 11, 13, 17, 19, 23, 29};
+static const uint8_t wheel30_gaps[] = {6, 4, 2, 4, 2, 4, 6, 2};
+_Static_assert(sizeof(wheel30_residues) == 8 && sizeof(wheel30_gaps) == 8,
+               "phi(30) residues");
+
+static const int64_t wheel210_primes[] = {2, 3, 5, 7};
+static const uint8_t wheel210_residues[] = {
+    1, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67,
+    71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 121, 127, 131, 137, 139,
+    143, 149, 151, 157, 163, 167, 169, 173, 179, 181, 187, 191, 193, 197, 199, 209};
+static const uint8_t wheel210_gaps[] = {
+    10, 2, 4, 2, 4, 6, 2, 6, 4, 2, 4, 6, 6, 2, 6, 4,
+    2, 6, 4, 6, 8, 4, 2, 4, 2, 4, 8, 6, 4, 6, 2, 4,
+    6, 2, 6, 6, 4, 2, 4, 6, 2, 6, 4, 2, 4, 2, 10, 2};
+_Static_assert(sizeof(wheel210_residues) == 48 && sizeof(wheel210_gaps) == 48,
+               "phi(210) residues");
+
+const struct wheel wheel30 = {30, 8, wheel30_primes, 3, wheel30_residues, wheel30_gaps};
+const struct wheel wheel210 = {210, 48, wheel210_primes, 4, wheel210_residues, wheel210_gaps};
+
+/* Count the primes in [start, end] by trial division over a wheel */
+int64_t count_primes_wheel(int64_t start, int64_t end, const struct wheel *w)
+{
+    int64_t count = 0;
+
+    if (start < 2)
+        start = 2;
+    for (int i = 0; i < w->prime_count; i++)
+        if (w->primes[i] >= start && w->primes[i] <= end)
+            count++;
+
+    /* Find the first candidate >= start that is coprime to the modulus */
+    int64_t value = start - start % w->modulus;
+    int index = 0;
+    while (value + w->residues[index] < start)
+    {
+        if (++index == w->size)
+        {
+            index = 0;
+            value += w->modulus;
+        }
+    }
+    value += w->residues[index];
+
+    for (; value <= end; value += w->gaps[index], index = (index + 1) % w->size)
+    {
+        /* The first divisor is the smallest prime above the wheel primes,
+           i.e. the second residue; 1 is never a candidate since start >= 2 */
+        bool is_prime = true;
+        int64_t iter = w->residues[1];
+        int divisor_index = 1;
+        while (iter * iter <= value)
+        {
+            if (value % iter == 0)
+            {
+                is_prime = false;
+                break;
+            }
+            iter += w->gaps[divisor_index];
+            divisor_index = (divisor_index + 1) % w->size;
+        }
+
+        if (is_prime)
+            count++;
+    }
+
+    return count;
+}
+
+int64_t count_primes_wheel30(int64_t start, int64_t end)
+{
+    return count_primes_wheel(start, end, &wheel30);
+}
+
+int64_t count_primes_wheel210(int64_t start, int64_t end)
+{
+    return count_primes_wheel(start, end, &wheel210);
+}
+
+/* Montgomery arithmetic modulo an odd n < 2^63 with R = 2^64. Residues
+   are kept in Montgomery form a * R mod n, so a modular multiply is two
+   64x64->128 multiplies and no division. */
+struct montgomery
+{
+    uint64_t n;
+    uint64_t n_neg_inv; /* -n^-1 mod 2^64 */
+    uint64_t r2;        /* R^2 mod n */
+    uint64_t one;       /* R mod n, i.e. 1 in Montgomery form */
+};
+
+static inline uint64_t montgomery_reduce(const struct montgomery *m, unsigned __int128 t)
+{
+    /* t < n * R and n < 2^63, so t + q * n cannot overflow 128 bits */
+    uint64_t q = (uint64_t)t * m->n_neg_inv;
+    uint64_t result = (t + (unsigned __int128)q * m->n) >> 64;
+    return result >= m->n ? result - m->n : result;
+}
+
+static inline uint64_t montgomery_multiply(const struct montgomery *m, uint64_t a, uint64_t b)
+{
+    return montgomery_reduce(m, (unsigned __int128)a * b);
+}
+
+void montgomery_init(struct montgomery *m, uint64_t n)
+{
+    /* Newton's iteration doubles the number of correct low bits of n^-1;
+       n * n == 1 (mod 8) gives the first three */
+    uint64_t inverse = n;
+    for (int i = 0; i < 5; i++)
+        inverse *= 2 - n * inverse;
+    m->n = n;
+    m->n_neg_inv = -inverse;
+    m->one = -n % n;
+    m->r2 = (unsigned __int128)m->one * m->one % n;
+}
+
+static inline uint64_t montgomery_power(const struct montgomery *m, uint64_t base, uint64_t exponent)
+{
+    uint64_t result = m->one;
+    while (exponent > 0)
+    {
+        if (exponent & 1)
+            result = montgomery_multiply(m, result, base);
+        base = montgomery_multiply(m, base, base);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+/* Deterministic Miller-Rabin. These seven bases have no common strong
+   pseudoprime below 2^64 (Jim Sinclair's set). */
+bool is_prime_miller_rabin(uint64_t n)
+{
+    static const uint64_t bases[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+    static const uint64_t small_primes[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+
+    if (n < 2)
+        return false;
+    for (size_t i = 0; i < sizeof(small_primes) / sizeof(small_primes[0]); i++)
+        if (n % small_primes[i] == 0)
+            return n == small_primes[i];
+    if (n < 37 * 37)
+        return true;
+
+    struct montgomery m;
+    montgomery_init(&m, n);
+    uint64_t minus_one = n - m.one;
+
+    /* n - 1 = d * 2^s with d odd */
+    uint64_t d = n - 1;
+    int s = __builtin_ctzll(d);
+    d >>= s;
+
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); i++)
+    {
+        uint64_t a = bases[i] % n;
+        if (a == 0)
+            continue;
+        uint64_t x = montgomery_power(&m, montgomery_multiply(&m, a, m.r2), d);
+        if (x == m.one || x == minus_one)
+            continue;
+        bool witness = true;
+        for (int r = 1; r < s && witness; r++)
+        {
+            x = montgomery_multiply(&m, x, x);
+            if (x == minus_one)
+                witness = false;
+        }
+        if (witness)
+            return false;
+    }
+    return true;
+}
+
+/* Count the primes in [start, end] with Miller-Rabin, odd numbers only */
+int64_t count_primes_miller_rabin(int64_t start, int64_t end)
+{
+    int64_t count = 0;
+
+    if (start < 2)
+        start = 2;
+    if (start == 2 && end >= 2)
+    {
+        count++;
+        start = 3;
+    }
+    for (int64_t value = start | 1; value <= end; value += 2)
+    {
+        if (is_prime_miller_rabin(value))
+            count++;
+        if (value > INT64_MAX - 2)
+            break;
+    }
+
+    return count;
+}
+
+/* Sense-reversing barrier for the Lucy threads. Waiters yield instead
+   of blocking, since a stage is often only a few microseconds of work. */
+struct spin_barrier
+{
+    atomic_int count;
+    atomic_int generation;
+    int total;
+};
+
+void spin_barrier_wait(struct spin_barrier *barrier)
+{
+    int generation = atomic_load(&barrier->generation);
+    if (atomic_fetch_add(&barrier->count, 1) == barrier->total - 1)
+    {
+        atomic_store(&barrier->count, 0);
+        atomic_fetch_add(&barrier->generation, 1);
+        return;
+    }
+    while (atomic_load(&barrier->generation) == generation)
+        sched_yield();
+}
+
+/* Lucy_Hedgehog's prime counting in O(x^3/4) time and O(x^1/2) memory.
+   S(v) starts as the count of [2, v] and, after sieving with every
+   prime p <= sqrt(v), is pi(v). Only the values v = x / i are needed;
+   those <= r = sqrt(x) live in small[v], the others in large[i]. Sieving
+   with p updates, for every v >= p^2,
+       S(v) -= S(v / p) - S(p - 1)
+   and each update must read the S(v / p) of the previous prime. */
+struct lucy_state
+{
+    int64_t x;
+    int64_t r;
+    int64_t *small; /* small[v] = S(v), v <= r */
+    int64_t *large; /* large[i] = S(x / i), i <= r */
+    int num_threads;
+    struct spin_barrier barrier;
+};
+
+struct lucy_thread
+{
+    struct lucy_state *state;
+    int thread;
+};
+
+/* A stage only runs in parallel while every thread gets at least this
+   many updates; the rest of the stages run on thread 0 alone */
+#define LUCY_PARALLEL_MIN 2048
+
+static inline void lucy_update_large(struct lucy_state *s, int64_t p, int64_t sp,
+                                     int64_t first, int64_t last)
+{
+    for (int64_t i = first; i <= last; i++)
+    {
+        int64_t d = i * p;
+        if (d <= s->r)
+            s->large[i] -= s->large[d] - sp;
+        else
+            s->large[i] -= s->small[s->x / d] - sp;
+    }
+}
+
+static inline void lucy_update_small(struct lucy_state *s, int64_t p, int64_t sp,
+                                     int64_t first, int64_t last)
+{
+    for (int64_t v = last; v >= first; v--)
+        s->small[v] -= s->small[v / p] - sp;
+}
+
+/* Split [first, last] evenly and update this thread's share */
+static inline void lucy_share(int64_t first, int64_t last, int thread, int num_threads,
+                              int64_t *share_first, int64_t *share_last)
+{
+    int64_t length = last - first + 1;
+    *share_first = first + length * thread / num_threads;
+    *share_last = first + length * (thread + 1) / num_threads - 1;
+}
+
+void *lucy_thread_function(void *_args)
+{
+    struct lucy_thread *args = (struct lucy_thread *)_args;
+    struct lucy_state *s = args->state;
+    int thread = args->thread;
+    int num_threads = s->num_threads;
+    int64_t min_parallel = (int64_t)LUCY_PARALLEL_MIN * num_threads;
+    bool parallel = num_threads > 1;
+    int64_t first, last;
+
+    for (int64_t p = 2; p <= s->r; p++)
+    {
+        /* small[p] and small[p - 1] are final once every prime below p
+           has been sieved, so all threads take the same branch here */
+        if (s->small[p] == s->small[p - 1])
+            continue;
+        int64_t sp = s->small[p - 1];
+        int64_t p2 = p * p;
+        int64_t large_end = s->r < s->x / p2 ? s->r : s->x / p2;
+        int64_t small_count = s->r >= p2 ? s->r - p2 + 1 : 0;
+
+        if (parallel && large_end + small_count < min_parallel)
+        {
+            /* Every later stage is smaller still: finish on thread 0 */
+            parallel = false;
+            if (thread != 0)
+                break;
+        }
+        if (!parallel)
+        {
+            lucy_update_large(s, p, sp, 1, large_end);
+            if (small_count > 0)
+                lucy_update_small(s, p, sp, p2, s->r);
+            continue;
+        }
+
+        /* large[i] reads large[i * p], which must not have been updated
+           yet. Entries in (large_end / p, large_end] only read entries
+           past large_end, so the indices are processed in bands
+           (large_end / p^(k+1), large_end / p^k] from the lowest band up;
+           each band only depends on the one above it. The low bands are
+           small and run on thread 0 in one go. */
+        int64_t band_high = large_end;
+        while (band_high / p > 0 && band_high - band_high / p >= min_parallel)
+            band_high /= p;
+        if (thread == 0)
+            lucy_update_large(s, p, sp, 1, band_high);
+        spin_barrier_wait(&s->barrier);
+        while (band_high < large_end)
+        {
+            int64_t band_low = band_high + 1;
+            band_high = band_high * p + p - 1 < large_end ? band_high * p + p - 1 : large_end;
+            lucy_share(band_low, band_high, thread, num_threads, &first, &last);
+            lucy_update_large(s, p, sp, first, last);
+            spin_barrier_wait(&s->barrier);
+        }
+
+        /* small[v] reads small[v / p], so the small values go in bands
+           from the top down; the low bands run on thread 0 at the end */
+        int64_t band_top = s->r;
+        while (band_top >= p2 && band_top - band_top / p >= min_parallel)
+        {
+            int64_t band_bottom = band_top / p + 1 > p2 ? band_top / p + 1 : p2;
+            lucy_share(band_bottom, band_top, thread, num_threads, &first, &last);
+            lucy_update_small(s, p, sp, first, last);
+            spin_barrier_wait(&s->barrier);
+            band_top = band_bottom - 1;
+        }
+        if (thread == 0 && band_top >= p2)
+            lucy_update_small(s, p, sp, p2, band_top);
+        spin_barrier_wait(&s->barrier);
+    }
+
+    pthread_exit(NULL);
+}
+
+/* pi(x), the number of primes <= x */
+int64_t lucy_prime_count(int64_t x, int num_threads)
+{
+    if (x < 2)
+        return 0;
+
+    struct lucy_state state;
+    state.x = x;
+    state.r = isqrt64(x);
+    state.small = malloc((state.r + 1) * sizeof(int64_t));
+    state.large = malloc((state.r + 1) * sizeof(int64_t));
+    state.num_threads = num_threads;
+    atomic_init(&state.barrier.count, 0);
+    atomic_init(&state.barrier.generation, 0);
+    state.barrier.total = num_threads;
+
+    state.small[0] = 0;
+    for (int64_t v = 1; v <= state.r; v++)
+        state.small[v] = v - 1;
+    state.large[0] = 0;
+    for (int64_t i = 1; i <= state.r; i++)
+        state.large[i] = x / i - 1;
+
+    pthread_t threads[num_threads];
+    struct lucy_thread args[num_threads];
+    for (int thread = 0; thread < num_threads; thread++)
+    {
+        args[thread].state = &state;
+        args[thread].thread = thread;
+        assert(pthread_create(&threads[thread], NULL, lucy_thread_function,
+                              &args[thread]) == 0);
+    }
+    for (int thread = 0; thread < num_threads; thread++)
+        pthread_join(threads[thread], NULL);
+
+    int64_t count = state.large[1];
+    free(state.small);
+    free(state.large);
+    return count;
+}
+
+/* A prime-counting engine counts the primes in [start, end]. The
+   prepare hook, if any, runs once on the main thread before the
+   threads start. Engines that compute pi(x) directly set prime_pi
+   instead of count and do their own threading. */
+struct prime_engine
+{
+    const char *name;
+    int64_t (*count)(int64_t start, int64_t end);
+    void (*prepare)(int64_t end);
+    int64_t (*prime_pi)(int64_t x, int num_threads);
+};
+
+const struct prime_engine prime_engines[] = {
+    {.name = "trial", .count = count_primes_trial},
+    {.name = "trialw", .count = count_primes_trial_width},
+    {.name = "sieve", .count = count_primes_sieve, .prepare = sieve_init},
+    {.name = "wheel30", .count = count_primes_wheel30},
+    {.name = "wheel210", .count = count_primes_wheel210},
+    {.name = "millerrabin", .count = count_primes_miller_rabin},
+    {.name = "fastmod", .count = count_primes_fastmod, .prepare = fastmod_init},
+    {.name = "simd", .count = count_primes_simd, .prepare = simd_init},
+    {.name = "lucy", .prime_pi = lucy_prime_count},
+};
+
+const struct prime_engine *engine = &prime_engines[0];
+
+/* How the range is split among threads, selected with -s */
+enum prime_schedule
+{
+    SCHEDULE_STATIC,
+    SCHEDULE_DYNAMIC,
+    SCHEDULE_COST,
+    SCHEDULE_CYCLIC,
+};
+
+const char *prime_schedule_names[] = {"static", "dynamic", "cost", "cyclic"};
+
+enum prime_schedule schedule = SCHEDULE_STATIC;
+
+/* Numbers per chunk for the dynamic and cyclic schedules, set with -c */
+int64_t chunk_size = 65536;
+
+double monotonic_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 /* Thread function for counting primes */
 void *
 prime_check(void *_args)
 {
     /* Cast the args to a usable struct type */
     struct range *args = (struct range *)_args;
-    int64_t iter = 2;
-    int64_t value;
+    double begin = monotonic_seconds();
 
     /* Skip over any numbers < 2, which is the smallest prime */
     if (args->start < 2)
         args->start = 2;
 
-    /* Loop from this thread's start to this thread's end */
+    args->count = engine->count(args->start, args->end);
+    args->busy = monotonic_seconds() - begin;
+
+    /* All values in the range have been counted, so exit */
+    pthread_exit(NULL);
+}
+
+/* Thread function for the dynamic schedule: keep claiming chunks from
+   the shared cursor until the whole range has been handed out */
+void *
+prime_check_dynamic(void *_args)
+{
+    struct range *args = (struct range *)_args;
+    struct prime_cursor *cursor = args->cursor;
+    int64_t length = cursor->end - cursor->start + 1;
+    double begin = monotonic_seconds();
+
     args->count = 0;
-    for (value = args->start; value <= args->end; value++)
+    for (;;)
     {
-        /* Trivial and intentionally slow algorithm:
-           Start with iter = 2; see if iter divides the number evenly.
-           If it does, it's not prime.
-           Stop when iter exceeds the square root of value */
-        bool is_prime = true;
-        for (iter = 2; iter * iter <= value && is_prime; iter++)
-            if (value % iter == 0)
-                is_prime = false;
+        int64_t offset = atomic_fetch_add(&cursor->next, cursor->chunk);
+        if (offset >= length)
+            break;
+        int64_t chunk_start = cursor->start + offset;
+        int64_t chunk_end = cursor->end;
+        if (length - offset > cursor->chunk)
+            chunk_end = chunk_start + cursor->chunk - 1;
+        args->count += engine->count(chunk_start, chunk_end);
+    }
+    args->busy = monotonic_seconds() - begin;
 
-        if (is_prime)
-            args->count++;
+    pthread_exit(NULL);
+}
+
+/* Thread function for the cyclic schedule: thread t takes chunks
+   t, t + num_threads, t + 2 * num_threads, ... of the range */
+void *
+prime_check_cyclic(void *_args)
+{
+    struct range *args = (struct range *)_args;
+    struct prime_cursor *cursor = args->cursor;
+    int64_t length = cursor->end - cursor->start + 1;
+    int64_t stride = cursor->chunk * args->num_threads;
+    double begin = monotonic_seconds();
+
+    args->count = 0;
+    for (int64_t offset = cursor->chunk * args->thread; offset < length;
+         offset += stride)
+    {
+        int64_t chunk_start = cursor->start + offset;
+        int64_t chunk_end = cursor->end;
+        if (length - offset > cursor->chunk)
+            chunk_end = chunk_start + cursor->chunk - 1;
+        args->count += engine->count(chunk_start, chunk_end);
+        if (length - offset <= stride)
+            break;
     }
+    args->busy = monotonic_seconds() - begin;
 
-    /* All values in the range have been counted, so exit */
     pthread_exit(NULL);
 }
 
-int multicore_processing_prime(int64_t digits, int num_threads)
+/* Cost model for trial division: testing n costs about sqrt(n)
+   divisions, so the work in [a, b) is the integral of sqrt(x), which
+   is 2/3 (b^1.5 - a^1.5) */
+long double prime_cost_integral(long double x)
+{
+    return 2.0L / 3.0L * x * sqrtl(x);
+}
+
+double prime_cost(int64_t a, int64_t b)
+{
+    return prime_cost_integral(b) - prime_cost_integral(a);
+}
+
+/* Inverse of prime_cost_integral: the x with integral(x) == work */
+int64_t prime_cost_inverse(long double work)
+{
+    return llroundl(powl(1.5L * work, 2.0L / 3.0L));
+}
+
+/* Estimated work of the chunks a cyclic thread owns */
+double prime_cost_cyclic(struct prime_cursor *cursor, int thread, int num_threads)
+{
+    int64_t length = cursor->end - cursor->start + 1;
+    double cost = 0;
+    for (int64_t offset = cursor->chunk * thread; offset < length;
+         offset += cursor->chunk * num_threads)
+    {
+        int64_t chunk_end = length - offset > cursor->chunk ? offset + cursor->chunk : length;
+        cost += prime_cost(cursor->start + offset, cursor->start + chunk_end);
+        if (length - offset <= cursor->chunk * num_threads)
+            break;
+    }
+    return cost;
+}
+
+/* Print how long each thread was busy, so load imbalance is visible.
+   For the schedules with a cost model, also print each partition's
+   share of the predicted work next to its share of the busy time. */
+void report_thread_balance(struct range *args[], int num_threads)
+{
+    double busy_max = 0, busy_total = 0, predicted_total = 0;
+    for (int thread = 0; thread < num_threads; thread++)
+    {
+        busy_total += args[thread]->busy;
+        predicted_total += args[thread]->predicted;
+        if (args[thread]->busy > busy_max)
+            busy_max = args[thread]->busy;
+    }
+    for (int thread = 0; thread < num_threads; thread++)
+    {
+        printf("Thread %d: %" PRId64 " primes, busy %.3f s",
+               thread, args[thread]->count, args[thread]->busy);
+        if (predicted_total > 0 && busy_total > 0)
+            printf(", predicted cost %.4g (%.1f%%), actual %.1f%%",
+                   args[thread]->predicted,
+                   100 * args[thread]->predicted / predicted_total,
+                   100 * args[thread]->busy / busy_total);
+        printf("\n");
+    }
+    if (busy_total > 0)
+        printf("Load imbalance (max / mean busy time): %.3f\n",
+               busy_max / (busy_total / num_threads));
+}
+
+/* First number of the counted range, set with -b. The range is
+   [range_start, range_start + digits). */
+int64_t range_start = 0;
+
+/* Number of primes below limit, or -1 if we have no reference value */
+int64_t known_prime_count(int64_t limit)
+{
+    static const int64_t powers_of_ten[] = {
+        0, 4, 25, 168, 1229, 9592, 78498, 664579, 5761455, 50847534,
+        455052511, 4118054813L, 37607912018L, 346065536839L};
+    int64_t power = 1;
+
+    if (limit == 50000000L)
+        return 3001134;
+    for (int i = 0; i < (int)(sizeof(powers_of_ten) / sizeof(powers_of_ten[0])); i++)
+    {
+        if (limit == power)
+            return powers_of_ten[i];
+        power *= 10;
+    }
+    return -1;
+}
+
+int64_t multicore_processing_prime(int64_t digits, int num_threads)
 {
     pthread_t threads[num_threads];
     struct range *args[num_threads];
@@ -116,21 +1189,72 @@ int multicore_processing_prime(int64_t digits, int num_threads)
 
     /* Specify start and end values, then split based on number of
        threads */
-    int64_t start = 0;
+    int64_t start = range_start;
     int64_t end = start + number_count;
     int64_t number_per_thread = number_count / num_threads;
+    int64_t remaining_numbers = number_count % num_threads;
+
+    if (engine->prime_pi != NULL)
+    {
+        int64_t total_number = engine->prime_pi(end - 1, num_threads);
+        if (start > 0)
+            total_number -= engine->prime_pi(start - 1, num_threads);
+        return total_number;
+    }
 
-    /* Simplification: make range divide evenly among the threads */
-    // assert(number_count % num_threads == 0);
+    if (engine->prepare != NULL)
+        engine->prepare(end);
 
-    /* Assign a start/end value for each thread, then create it */
+    struct prime_cursor cursor;
+    atomic_init(&cursor.next, 0);
+    cursor.start = start;
+    cursor.end = end - 1;
+    cursor.chunk = chunk_size;
+
+    /* Assign a start/end value for each thread, then create it. The
+       first number_count % num_threads threads take one extra number;
+       the cost schedule instead cuts blocks of equal prime_cost. */
+    long double cost_begin = prime_cost_integral(start);
+    long double cost_total = prime_cost_integral(end) - cost_begin;
+    int64_t next_start = start;
     for (thread = 0; thread < num_threads; thread++)
     {
         args[thread] = calloc(sizeof(struct range), 1);
-        args[thread]->start = start + (thread * number_per_thread);
+        args[thread]->cursor = &cursor;
+        args[thread]->thread = thread;
+        args[thread]->num_threads = num_threads;
+        args[thread]->start = next_start;
         args[thread]->end =
             args[thread]->start + number_per_thread - 1;
-        assert(pthread_create(&threads[thread], NULL, prime_check,
+        if (thread < remaining_numbers)
+            args[thread]->end++;
+        if (schedule == SCHEDULE_COST)
+        {
+            args[thread]->end = end - 1;
+            if (thread < num_threads - 1)
+                args[thread]->end = prime_cost_inverse(
+                                        cost_begin + cost_total * (thread + 1) / num_threads) -
+                                    1;
+            if (args[thread]->end > end - 1)
+                args[thread]->end = end - 1;
+            if (args[thread]->end < args[thread]->start - 1)
+                args[thread]->end = args[thread]->start - 1;
+        }
+        next_start = args[thread]->end + 1;
+
+        void *(*thread_function)(void *) = prime_check;
+        args[thread]->predicted = prime_cost(args[thread]->start, args[thread]->end + 1);
+        if (schedule == SCHEDULE_DYNAMIC)
+        {
+            thread_function = prime_check_dynamic;
+            args[thread]->predicted = 0;
+        }
+        else if (schedule == SCHEDULE_CYCLIC)
+        {
+            thread_function = prime_check_cyclic;
+            args[thread]->predicted = prime_cost_cyclic(&cursor, thread, num_threads);
+        }
+        assert(pthread_create(&threads[thread], NULL, thread_function,
                               args[thread]) == 0);
     }
 
@@ -142,35 +1266,91 @@ int multicore_processing_prime(int64_t digits, int num_threads)
         // printf("From %ld to %ld: %ld\n", args[thread]->start,
         //        args[thread]->end, args[thread]->count);
         total_number += args[thread]->count;
-        free(args[thread]);
     }
 
+    if (num_threads > 1)
+        report_thread_balance(args, num_threads);
+    for (thread = 0; thread < num_threads; thread++)
+        free(args[thread]);
+
     /* Display the total number of primes in the specified range. */
     // printf("===============================================\n");
     // printf("Total number of primes less than %ld: %ld\n", end,
     //        total_number);
 
-    return 0;
+    return total_number;
 }
 
-double calculate_execution_time(int digits, int num_threads)
+double calculate_execution_time(int64_t digits, int num_threads, int64_t *total)
 {
 
     struct timeval start, end;
     gettimeofday(&start, NULL);
-    multicore_processing_prime(digits, num_threads);
+    int64_t result = multicore_processing_prime(digits, num_threads);
+    DO_NOT_OPTIMIZE(result);
     gettimeofday(&end, NULL);
+    *total = result;
     double time_taken = end.tv_sec + end.tv_usec / 1e6 -
                         start.tv_sec - start.tv_usec / 1e6; // in seconds
     return time_taken;
 }
 
-int calculate_score(int digits, double execution_time)
+/* Print a verification line and return whether it passed */
+bool verify(const char *what, bool passed)
+{
+    printf("Verification of %s: %s\n", what, passed ? "passed" : "FAILED");
+    return passed;
+}
+
+/* Schedules hand out empty slices such as [0, -1] when a range starts
+   at 0, so an engine has to count them as 0 primes. Runs after the
+   timed runs, which have prepared the engine */
+bool engine_counts_empty_ranges(void)
+{
+    static const int64_t empty_ranges[][2] = {{0, -1}, {1, 0}, {10, 9}, {-10, -5}, {100, 50}};
+    if (engine->count == NULL)
+        return true;
+    for (size_t i = 0; i < sizeof(empty_ranges) / sizeof(empty_ranges[0]); i++)
+        if (engine->count(empty_ranges[i][0], empty_ranges[i][1]) != 0)
+            return false;
+    return true;
+}
+
+int calculate_score(int64_t digits, double execution_time)
 {
     int multi_core_score = (digits / execution_time) / 666;
     return round(multi_core_score);
 }
 
+/* Numbers timed by the divide-width comparison */
+#define DIVIDE_WIDTH_SAMPLE 1000000
+
+/* Time the 64-bit and 32-bit trial-division kernels on one thread over
+   the same numbers, the top of the range, where divides dominate */
+void report_divide_width(int64_t start, int64_t end)
+{
+    int64_t last = end - 1;
+    int64_t first = last - DIVIDE_WIDTH_SAMPLE + 1 > start ? last - DIVIDE_WIDTH_SAMPLE + 1 : start;
+
+    if (last >= UINT32_MAX)
+    {
+        printf("Divide width comparison skipped: %" PRId64 " does not fit in 32 bits\n", last);
+        return;
+    }
+
+    double begin = monotonic_seconds();
+    int64_t count64 = count_primes_trial(first, last);
+    double time64 = monotonic_seconds() - begin;
+    begin = monotonic_seconds();
+    int64_t count32 = count_primes_trial32(first, last);
+    double time32 = monotonic_seconds() - begin;
+
+    printf("Divide width comparison on [%" PRId64 ", %" PRId64 "]: 64-bit %f s, 32-bit %f s, "
+           "32-bit speedup %f%s\n",
+           first, last, time64, time32, time64 / time32,
+           count64 == count32 ? "" : " (COUNTS DIFFER)");
+}
+
 size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
 {
     // Simply print the response to the console
@@ -179,9 +1359,106 @@ size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
     return size * nmemb;
 }
 
+void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-e engine] [-s schedule] [-c chunk] [-n limit] [-b base] [-k segment_kib] [-i isa] [-w]\n", program);
+    fprintf(stderr, "  -e engine       prime-counting engine:");
+    for (size_t i = 0; i < sizeof(prime_engines) / sizeof(prime_engines[0]); i++)
+        fprintf(stderr, " %s", prime_engines[i].name);
+    fprintf(stderr, " (default %s)\n", prime_engines[0].name);
+    fprintf(stderr, "  -s schedule     thread schedule:");
+    for (size_t i = 0; i < sizeof(prime_schedule_names) / sizeof(prime_schedule_names[0]); i++)
+        fprintf(stderr, " %s", prime_schedule_names[i]);
+    fprintf(stderr, " (default %s)\n", prime_schedule_names[0]);
+    fprintf(stderr, "  -c chunk        numbers per chunk for the dynamic and cyclic schedules (default %" PRId64 ")\n",
+            chunk_size);
+    fprintf(stderr, "  -n limit        count the primes below limit (default 50000000)\n");
+    fprintf(stderr, "  -b base         count in [base, base + limit) instead; up to 2^63 with millerrabin\n");
+    fprintf(stderr, "  -k segment_kib  sieve segment size in KiB (default %" PRId64 ")\n",
+            sieve_segment_bytes / 1024);
+    fprintf(stderr, "  -i isa          cap the simd engine at scalar, avx2 or avx512 (default: best available)\n");
+    fprintf(stderr, "  -w              also time 64-bit against 32-bit trial division\n");
+    fprintf(stderr, "Runs with any option are reported locally and not uploaded.\n");
+    exit(EXIT_FAILURE);
+}
+
+const struct prime_engine *find_prime_engine(const char *name)
+{
+    for (size_t i = 0; i < sizeof(prime_engines) / sizeof(prime_engines[0]); i++)
+        if (strcmp(name, prime_engines[i].name) == 0)
+            return &prime_engines[i];
+    return NULL;
+}
+
+/* Index of name in names, or -1 */
+int find_name(const char *name, const char *names[], int count)
+{
+    for (int i = 0; i < count; i++)
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    return -1;
+}
+
 int main(int argc, char **argv)
 {
     int64_t digits = 50000000L;
+    bool upload = true;
+    bool divide_width = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "e:s:c:n:b:k:i:w")) != -1)
+    {
+        switch (opt)
+        {
+        case 'e':
+            engine = find_prime_engine(optarg);
+            if (engine == NULL)
+                usage(argv[0]);
+            break;
+        case 's':
+        {
+            int index = find_name(optarg, prime_schedule_names,
+                                  sizeof(prime_schedule_names) / sizeof(prime_schedule_names[0]));
+            if (index < 0)
+                usage(argv[0]);
+            schedule = index;
+            break;
+        }
+        case 'c':
+            chunk_size = strtoll(optarg, NULL, 10);
+            if (chunk_size < 1)
+                usage(argv[0]);
+            break;
+        case 'n':
+            digits = strtoll(optarg, NULL, 10);
+            if (digits < 1)
+                usage(argv[0]);
+            break;
+        case 'b':
+            range_start = strtoll(optarg, NULL, 10);
+            if (range_start < 0)
+                usage(argv[0]);
+            break;
+        case 'k':
+            sieve_segment_bytes = strtoll(optarg, NULL, 10) * 1024;
+            if (sieve_segment_bytes < 1024)
+                usage(argv[0]);
+            break;
+        case 'i':
+            if (strcmp(optarg, "scalar") != 0 && strcmp(optarg, "avx2") != 0 &&
+                strcmp(optarg, "avx512") != 0)
+                usage(argv[0]);
+            simd_isa = optarg;
+            break;
+        case 'w':
+            divide_width = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+        upload = false;
+    }
+    if (digits > INT64_MAX - range_start)
+        usage(argv[0]);
     srand(time(NULL));
     int processes;
     char cpu_model[256];
@@ -345,19 +1622,36 @@ int main(int argc, char **argv)
 
 #endif
 
-    double execution_time_single_core = calculate_execution_time(digits, 1);
-    double execution_time_multi_core = calculate_execution_time(digits, processes);
+    int64_t total_single_core, total_multi_core;
+    double execution_time_single_core = calculate_execution_time(digits, 1, &total_single_core);
+    double execution_time_multi_core = calculate_execution_time(digits, processes, &total_multi_core);
     printf("CPU Model%s", model_info);
     printf("\n");
     printf(os_display);
     printf("\n");
-    printf("Execution time for %d digits with single core is %f\n", digits, execution_time_single_core);
-    printf("Execution time for %d digits with %d cores is %f\n", digits, processes, execution_time_multi_core);
-    printf("Single core score for %d digits is %d\n", digits, calculate_score(digits, execution_time_single_core));
-    printf("Multi core score for %d digits is %d\n", digits, calculate_score(digits, execution_time_multi_core));
-    printf("Speedup for %d digits is %f\n", digits, execution_time_single_core / execution_time_multi_core);
-    printf("Efficiency for %d digits is %f\n", digits, (execution_time_single_core / execution_time_multi_core) / processes);
-    printf("CPU utilization for %d digits is %f%%\n", digits, 100 - (execution_time_multi_core / execution_time_single_core) * 100);
+    printf("Engine: %s, schedule: %s", engine->name, prime_schedule_names[schedule]);
+    if (engine->count == count_primes_simd)
+        printf(", instruction set: %s", simd_isa);
+    printf("\n");
+    printf("Primes in [%" PRId64 ", %" PRId64 "): %" PRId64 " (single core), %" PRId64 " (%d cores)",
+           range_start, range_start + digits, total_single_core, total_multi_core, processes);
+    int64_t expected = known_prime_count(digits);
+    if (expected >= 0 && range_start == 0)
+        printf(", expected %" PRId64, expected);
+    printf("\n");
+    bool valid = verify("single and multi core counts", total_single_core == total_multi_core);
+    if (expected >= 0 && range_start == 0)
+        valid = verify("prime count against known pi(x)", total_single_core == expected) && valid;
+    valid = verify("empty ranges", engine_counts_empty_ranges()) && valid;
+    if (divide_width)
+        report_divide_width(range_start, range_start + digits);
+    printf("Execution time for %" PRId64 " digits with single core is %f\n", digits, execution_time_single_core);
+    printf("Execution time for %" PRId64 " digits with %d cores is %f\n", digits, processes, execution_time_multi_core);
+    printf("Single core score for %" PRId64 " digits is %d\n", digits, calculate_score(digits, execution_time_single_core));
+    printf("Multi core score for %" PRId64 " digits is %d\n", digits, calculate_score(digits, execution_time_multi_core));
+    printf("Speedup for %" PRId64 " digits is %f\n", digits, execution_time_single_core / execution_time_multi_core);
+    printf("Efficiency for %" PRId64 " digits is %f\n", digits, (execution_time_single_core / execution_time_multi_core) / processes);
+    printf("CPU utilization for %" PRId64 " digits is %f%%\n", digits, 100 - (execution_time_multi_core / execution_time_single_core) * 100);
 
     // Generate 32 digit hex key
     char key[33];
@@ -398,6 +1692,14 @@ int main(int argc, char **argv)
     char jsonString[1024];
     primeBenchmarkToJson(prime_benchmark, jsonString);
 
+    if (!valid)
+    {
+        printf("Result verification failed, run marked invalid and not uploaded\n");
+        return EXIT_FAILURE;
+    }
+    if (!upload)
+        return 0;
+
     // Server information
     const char *host = "taipan-benchmarks.vercel.app";
     const char *path = "/api/cpu-benchmarks";
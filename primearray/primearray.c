@@ -16,6 +16,11 @@
 #include <openssl/err.h>
 #define MAX_BUFFER_SIZE 1024
 
+/* Optimization barrier: the compiler has to assume value is read and
+   changed here, so the work that produced it cannot be dropped or
+   folded away */
+#define DO_NOT_OPTIMIZE(value) __asm__ volatile("" : "+g"(value) : : "memory")
+
 /* Each thread gets a start and end number and returns the number
    Of primes in that range */
 struct range
@@ -71,92 +76,191 @@ void primeBenchmarkToJson(struct prime_benchmark benchmark, char *jsonString)
             benchmark.time, benchmark.hostname, benchmark.key, benchmark.processes);
 }
 
+/* Print a verification line and return whether it passed */
+bool verify(const char *what, bool passed)
+{
+    printf("Verification of %s: %s\n", what, passed ? "passed" : "FAILED");
+    return passed;
+}
+
 // Structure to pass arguments to the thread function
 struct range_array
 {
-    int64_t *array;
+    int *array;
+    int *scratch;
     int64_t start;
     int64_t end;
+    bool start_in_scratch;
 };
 
-// Function to merge two sorted arrays
-void merge(int *array, int start, int mid, int end)
-{
-    int n1 = mid - start + 1;
-    int n2 = end - mid;
+/* Runs this short are insertion sorted before any merging */
+#define INSERTION_SORT_CUTOFF 32
 
-    int *left = malloc(n1 * sizeof(int));
-    int *right = malloc(n2 * sizeof(int));
-
-    for (int i = 0; i < n1; i++)
-        left[i] = array[start + i];
-    for (int j = 0; j < n2; j++)
-        right[j] = array[mid + 1 + j];
+// Function to insertion sort array[start, end)
+void insertion_sort(int *array, int start, int end)
+{
+    for (int i = start + 1; i < end; i++)
+    {
+        int value = array[i];
+        int j = i - 1;
+        while (j >= start && array[j] > value)
+        {
+            array[j + 1] = array[j];
+            j--;
+        }
+        array[j + 1] = value;
+    }
+}
 
-    int i = 0, j = 0, k = start;
+// Function to merge the sorted arrays left[0, n1) and right[0, n2) into dst; ties take left first
+void merge(const int *left, int n1, const int *right, int n2, int *dst)
+{
+    int i = 0, j = 0, k = 0;
     while (i < n1 && j < n2)
     {
         if (left[i] <= right[j])
         {
-            array[k] = left[i];
+            dst[k] = left[i];
             i++;
         }
         else
         {
-            array[k] = right[j];
+            dst[k] = right[j];
             j++;
         }
         k++;
     }
 
-    while (i < n1)
-    {
-        array[k] = left[i];
-        i++;
-        k++;
-    }
+    memcpy(dst + k, left + i, (n1 - i) * sizeof(int));
+    k += n1 - i;
+    memcpy(dst + k, right + j, (n2 - j) * sizeof(int));
+}
 
-    while (j < n2)
+// Function to merge the sorted runs src[start, mid) and src[mid, end) into dst[start, end)
+void merge_runs(const int *src, int *dst, int start, int mid, int end)
+{
+    merge(src + start, mid - start, src + mid, end - mid, dst + start);
+}
+
+/* Bottom-up merge sort of array[start, end], with scratch[start, end] as
+   the only extra memory: runs of INSERTION_SORT_CUTOFF are insertion
+   sorted in place, then each pass merges pairs of runs from one buffer
+   into the other and the two buffers swap roles */
+void merge_sort(int *array, int *scratch, int start, int end)
+{
+    int size = end - start + 1;
+    if (size < 2)
+        return;
+    for (int i = start; i <= end; i += INSERTION_SORT_CUTOFF)
+        insertion_sort(array, i, i + INSERTION_SORT_CUTOFF <= end ? i + INSERTION_SORT_CUTOFF : end + 1);
+
+    int *src = array, *dst = scratch;
+    for (int64_t width = INSERTION_SORT_CUTOFF; width < size; width *= 2)
     {
-        array[k] = right[j];
-        j++;
-        k++;
+        for (int64_t i = start; i <= end; i += 2 * width)
+        {
+            int mid = i + width <= end ? i + width : end + 1;
+            int stop = i + 2 * width <= end ? i + 2 * width : end + 1;
+            merge_runs(src, dst, i, mid, stop);
+        }
+        int *t = src;
+        src = dst;
+        dst = t;
     }
 
-    free(left);
-    free(right);
+    // An odd number of passes leaves the result in scratch
+    if (src != array)
+        memcpy(array + start, src + start, size * sizeof(int));
 }
 
-// Function to perform merge sort on a range of the array
-void merge_sort(int *array, int start, int end)
+// Thread function for sorting a portion of the array
+void *sort_array_thread(void *_args)
 {
-    if (start < end)
-    {
-        int mid = start + (end - start) / 2;
+    struct range_array *args = (struct range_array *)_args;
+    merge_sort(args->array, args->scratch, args->start, args->end);
+
+    /* The merge levels alternate between the buffers and have to end in
+       array, so with an odd number of them they start from scratch */
+    if (args->start_in_scratch)
+        memcpy(args->scratch + args->start, args->array + args->start,
+               (args->end - args->start + 1) * sizeof(int));
 
-        merge_sort(array, start, mid);
-        merge_sort(array, mid + 1, end);
+    pthread_exit(NULL);
+}
 
-        merge(array, start, mid, end);
+/* One level of the final merge: sorted segment p is src[bounds[p],
+   bounds[p + 1]), and segments 2q and 2q + 1 merge into dst at the same
+   place (a last odd segment is copied). Each thread writes an equal slice
+   [start, end) of dst, so all threads take part in every merge */
+struct merge_level
+{
+    const int *src;
+    int *dst;
+    const int *bounds;
+    int segments;
+};
+
+struct merge_slice
+{
+    const struct merge_level *level;
+    int start;
+    int end;
+};
+
+/* Merge path: how many of the first k outputs of merging a and b come
+   from a. Too few while a[i] would still be taken before b[k - i - 1] */
+int co_rank(int k, const int *a, int na, const int *b, int nb)
+{
+    int low = k > nb ? k - nb : 0;
+    int high = k < na ? k : na;
+    while (low < high)
+    {
+        int i = low + (high - low) / 2;
+        if (a[i] <= b[k - i - 1])
+            low = i + 1;
+        else
+            high = i;
     }
+    return low;
 }
 
-// Thread function for sorting a portion of the array
-void *sort_array_thread(void *_args)
+// Thread function for one slice of a merge level
+void *merge_level_thread(void *_args)
 {
-    struct range_array *args = (struct range_array *)_args;
-    merge_sort(args->array, args->start, args->end);
+    struct merge_slice *args = (struct merge_slice *)_args;
+    const struct merge_level *level = args->level;
+    for (int p = 0; p < level->segments; p += 2)
+    {
+        int start = level->bounds[p];
+        int mid = level->bounds[p + 1];
+        int end = p + 2 <= level->segments ? level->bounds[p + 2] : mid;
+        int low = args->start > start ? args->start : start;
+        int high = args->end < end ? args->end : end;
+        if (low >= high)
+            continue;
+
+        const int *a = level->src + start, *b = level->src + mid;
+        int i0 = co_rank(low - start, a, mid - start, b, end - mid);
+        int i1 = co_rank(high - start, a, mid - start, b, end - mid);
+        int j0 = low - start - i0, j1 = high - start - i1;
+        merge(a + i0, i1 - i0, b + j0, j1 - j0, level->dst + low);
+    }
 
     pthread_exit(NULL);
 }
 
 // Function to sort an array using multiple threads
-void multicore_processing_sort(int *array, int array_size, int num_threads)
+void multicore_processing_sort(int *array, int *scratch, int array_size, int num_threads)
 {
     pthread_t threads[num_threads];
     struct range_array args[num_threads];
+    int bounds[num_threads + 1];
     int thread;
 
+    int levels = 0;
+    while ((1 << levels) < num_threads)
+        levels++;
+
     int elements_per_thread = array_size / num_threads;
     int remaining_elements = array_size % num_threads;
 
@@ -164,8 +268,10 @@ void multicore_processing_sort(int *array, int array_size, int num_threads)
     for (thread = 0; thread < num_threads; thread++)
     {
         args[thread].array = array;
+        args[thread].scratch = scratch;
         args[thread].start = start;
         args[thread].end = start + elements_per_thread - 1;
+        args[thread].start_in_scratch = levels % 2 == 1;
 
         if (remaining_elements > 0)
         {
@@ -173,10 +279,12 @@ void multicore_processing_sort(int *array, int array_size, int num_threads)
             remaining_elements--;
         }
 
+        bounds[thread] = start;
         start = args[thread].end + 1;
 
         assert(pthread_create(&threads[thread], NULL, sort_array_thread, &args[thread]) == 0);
     }
+    bounds[num_threads] = array_size;
 
     // Join all threads to wait for sorting completion
     for (thread = 0; thread < num_threads; thread++)
@@ -184,41 +292,72 @@ void multicore_processing_sort(int *array, int array_size, int num_threads)
         pthread_join(threads[thread], NULL);
     }
 
-    // Merge the sorted segments
-    int merged_size = elements_per_thread * num_threads;
-    while (merged_size < array_size)
+    // Merge the sorted segments pairwise, level by level, with every thread on every level
+    struct merge_level level = {levels % 2 == 1 ? scratch : array, levels % 2 == 1 ? array : scratch,
+                                bounds, num_threads};
+    struct merge_slice slices[num_threads];
+    while (level.segments > 1)
     {
-        for (int i = 0; i < array_size; i += merged_size * 2)
+        for (thread = 0; thread < num_threads; thread++)
         {
-            int start = i;
-            int mid = i + merged_size - 1;
-            int end = i + merged_size * 2 - 1;
-
-            if (mid >= array_size)
-                continue;
-
-            if (end >= array_size)
-                end = array_size - 1;
-
-            merge(array, start, mid, end);
+            slices[thread].level = &level;
+            slices[thread].start = (int64_t)array_size * thread / num_threads;
+            slices[thread].end = (int64_t)array_size * (thread + 1) / num_threads;
+            assert(pthread_create(&threads[thread], NULL, merge_level_thread, &slices[thread]) == 0);
+        }
+        for (thread = 0; thread < num_threads; thread++)
+        {
+            pthread_join(threads[thread], NULL);
         }
 
-        merged_size *= 2;
+        // Segment q of the next level is segments 2q and 2q + 1 of this one
+        for (int q = 0; 2 * q < level.segments; q++)
+            bounds[q] = bounds[2 * q];
+        bounds[(level.segments + 1) / 2] = array_size;
+        level.segments = (level.segments + 1) / 2;
+        int *t = (int *)level.src;
+        level.src = level.dst;
+        level.dst = t;
     }
 }
 
-// Calculate execution time of sorting
+/* Calculate execution time of sorting. The scratch buffer is allocated
+   and touched before the clock starts, so that neither malloc nor the
+   first page faults on it are timed */
 double calculate_execution_time_sort(int *array, int array_size, int num_threads)
 {
     struct timeval start, end;
+    int *scratch = malloc(array_size * sizeof(int));
+    assert(scratch != NULL);
+    memset(scratch, 0, array_size * sizeof(int));
     gettimeofday(&start, NULL);
-    multicore_processing_sort(array, array_size, num_threads);
+    multicore_processing_sort(array, scratch, array_size, num_threads);
+    DO_NOT_OPTIMIZE(array);
     gettimeofday(&end, NULL);
+    free(scratch);
     double time_taken = end.tv_sec + end.tv_usec / 1e6 -
                         start.tv_sec - start.tv_usec / 1e6; // in seconds
     return time_taken;
 }
 
+/* Sum of all elements, so the sort can be checked for lost or duplicated values */
+int64_t array_checksum(int *array, int array_size)
+{
+    int64_t sum = 0;
+    for (int i = 0; i < array_size; i++)
+        sum += array[i];
+    return sum;
+}
+
+/* The sorted array must be non-decreasing and keep the input's checksum */
+bool verify_sorted(const char *what, int *array, int array_size, int64_t checksum)
+{
+    bool sorted = true;
+    for (int i = 1; i < array_size && sorted; i++)
+        sorted = array[i - 1] <= array[i];
+    return verify(what, sorted && array_checksum(array, array_size) == checksum);
+}
+
 // Calculate score of sorting
 int calculate_score_sort(int *array, int array_size, double execution_time)
 {
@@ -260,7 +399,7 @@ prime_check(void *_args)
     pthread_exit(NULL);
 }
 
-int multicore_processing_prime(int64_t digits, int num_threads)
+int64_t multicore_processing_prime(int64_t digits, int num_threads)
 {
     pthread_t threads[num_threads];
     struct range *args[num_threads];
@@ -274,17 +413,20 @@ int multicore_processing_prime(int64_t digits, int num_threads)
     int64_t start = 0;
     int64_t end = start + number_count;
     int64_t number_per_thread = number_count / num_threads;
+    int64_t remaining_numbers = number_count % num_threads;
 
-    /* Simplification: make range divide evenly among the threads */
-    // assert(number_count % num_threads == 0);
-
-    /* Assign a start/end value for each thread, then create it */
+    /* Assign a start/end value for each thread, then create it. The
+       first number_count % num_threads threads take one extra number. */
+    int64_t next_start = start;
     for (thread = 0; thread < num_threads; thread++)
     {
         args[thread] = calloc(sizeof(struct range), 1);
-        args[thread]->start = start + (thread * number_per_thread);
+        args[thread]->start = next_start;
         args[thread]->end =
             args[thread]->start + number_per_thread - 1;
+        if (thread < remaining_numbers)
+            args[thread]->end++;
+        next_start = args[thread]->end + 1;
         assert(pthread_create(&threads[thread], NULL, prime_check,
                               args[thread]) == 0);
     }
@@ -305,21 +447,34 @@ int multicore_processing_prime(int64_t digits, int num_threads)
     // printf("Total number of primes less than %ld: %ld\n", end,
     //        total_number);
 
-    return 0;
+    return total_number;
 }
 
-double calculate_execution_time_prime(int digits, int num_threads)
+double calculate_execution_time_prime(int digits, int num_threads, int64_t *total)
 {
 
     struct timeval start, end;
     gettimeofday(&start, NULL);
-    multicore_processing_prime(digits, num_threads);
+    int64_t result = multicore_processing_prime(digits, num_threads);
+    DO_NOT_OPTIMIZE(result);
     gettimeofday(&end, NULL);
+    *total = result;
     double time_taken = end.tv_sec + end.tv_usec / 1e6 -
                         start.tv_sec - start.tv_usec / 1e6; // in seconds
     return time_taken;
 }
 
+/* pi(5 * 10^7), the prime count the benchmark's default limit must give */
+#define PRIMES_BELOW_50M 3001134
+
+bool verify_prime_count(const char *what, int64_t digits, int64_t count)
+{
+    printf("%s prime count below %" PRId64 ": %" PRId64 "\n", what, digits, count);
+    if (digits != 50000000L)
+        return true;
+    return verify(what, count == PRIMES_BELOW_50M);
+}
+
 int calculate_score_prime(int digits, double execution_time)
 {
     int multi_core_score = (digits / execution_time) / 666;
@@ -580,6 +735,7 @@ int main(int argc, char **argv)
     {
         array[i] = rand() % 1000;
     }
+    int64_t checksum = array_checksum(array, ARRAY_SIZE);
 
     // double execution_time_single_core_e = calculate_execution_time_e(digits_e, 1);
     // double execution_time_multi_core_e = calculate_execution_time_e(digits_e, processes);
@@ -603,15 +759,21 @@ int main(int argc, char **argv)
     {
         array2[i] = rand() % 1000;
     }
+    int64_t checksum2 = array_checksum(array2, ARRAY_SIZE);
     printf("Starting sorting multi core...\n");
     double execution_time_multi_core_time_sort = calculate_execution_time_sort(array2, ARRAY_SIZE, processes);
     printf("Ending sorting multi core...\n");
+    int64_t primes_single_core, primes_multi_core;
     printf("Starting prime single core...\n");
-    double execution_time_single_core_time_prime = calculate_execution_time_prime(digits_prime, 1);
+    double execution_time_single_core_time_prime = calculate_execution_time_prime(digits_prime, 1, &primes_single_core);
     printf("Ending prime single core...\n");
     printf("Starting prime multi core...\n");
-    double execution_time_multi_core_time_prime = calculate_execution_time_prime(digits_prime, processes);
+    double execution_time_multi_core_time_prime = calculate_execution_time_prime(digits_prime, processes, &primes_multi_core);
     printf("Ending prime multi core...\n");
+    bool valid = verify_sorted("single core sort", array, ARRAY_SIZE, checksum);
+    valid = verify_sorted("multi core sort", array2, ARRAY_SIZE, checksum2) && valid;
+    valid = verify_prime_count("single core", digits_prime, primes_single_core) && valid;
+    valid = verify_prime_count("multi core", digits_prime, primes_multi_core) && valid;
     double execution_time_single_core = (execution_time_single_core_time_sort + execution_time_single_core_time_prime) / 2;
     double execution_time_multi_core = (execution_time_multi_core_time_sort + execution_time_multi_core_time_prime) / 2;
     int64_t score_single_core_time_sort = calculate_score_sort(array, ARRAY_SIZE, execution_time_single_core);
@@ -671,6 +833,12 @@ int main(int argc, char **argv)
     char jsonString[1024];
     primeBenchmarkToJson(prime_benchmark, jsonString);
 
+    if (!valid)
+    {
+        printf("Result verification failed, run marked invalid\n");
+        return EXIT_FAILURE;
+    }
+
     // Server information
     // const char *host = "taipan-benchmarks.vercel.app";
     // const char *path = "/api/cpu-benchmarks";